@@ -0,0 +1,96 @@
+#ifndef tp_utils_AsyncFileIO_h
+#define tp_utils_AsyncFileIO_h
+
+#include "tp_utils/Globals.h"
+
+#include <future>
+
+namespace tp_utils
+{
+
+//##################################################################################################
+//! Reads and writes whole files asynchronously
+/*!
+On Linux this uses io_uring, a single thread owns the ring and drives each request through openat,
+read or write, and close without blocking, so that many small files can be in flight at once
+instead of each one waiting on the latency of the previous one. Requests that are made while others
+are in flight are submitted together in a single io_uring_enter call.
+
+If io_uring is not available (old kernels, seccomp sandboxes, other platforms) requests are handed to
+a pool of threads that perform the same operations synchronously. If the ring fails while running
+the requests that are waiting are failed and later requests are processed by the ring's thread.
+
+Writes are atomic in the same way as writeBinaryFile(), the data is written to a temporary file that
+is then renamed over the target. The same rules decide the target, symlinks are followed and hard
+links and special files are written in place, see replacementFilePath().
+
+Callbacks are called from an internal thread, they should be short and must not wait on other
+requests made to the same AsyncFileIO.
+
+<pre>
+tp_utils::AsyncFileIO io;
+for(const auto& path : paths)
+  io.readFile(path, [](bool ok, std::string& data){...});
+io.waitForAll();
+</pre>
+*/
+class TP_UTILS_SHARED_EXPORT AsyncFileIO
+{
+  TP_NONCOPYABLE(AsyncFileIO);
+public:
+  //################################################################################################
+  /*!
+  \param queueDepth - The maximum number of requests that will be in flight at once.
+  \param threads - The number of threads to use if io_uring is not available, 0 for one per core.
+  */
+  AsyncFileIO(size_t queueDepth=256, size_t threads=0);
+
+  //################################################################################################
+  //! Waits for all outstanding requests to complete.
+  ~AsyncFileIO();
+
+  //################################################################################################
+  //! Returns true if requests are processed with io_uring rather than the thread pool.
+  bool usingIOUring() const;
+
+  //################################################################################################
+  //! Read the whole of a file.
+  /*!
+  \param fileName - The path of the file to read.
+  \param callback - Called with the contents of the file, the data can be moved out.
+  */
+  void readFile(const std::string& fileName, const std::function<void(bool ok, std::string& data)>& callback);
+
+  //################################################################################################
+  //! Read the whole of a file, the future will hold an empty string if the read fails.
+  std::future<std::string> readFile(const std::string& fileName);
+
+  //################################################################################################
+  //! Write data to a file replacing its contents.
+  void writeFile(const std::string& fileName, std::string data, const std::function<void(bool ok)>& callback);
+
+  //################################################################################################
+  //! Write data to a file, the future will hold true if the write succeeded.
+  std::future<bool> writeFile(const std::string& fileName, std::string data);
+
+  //################################################################################################
+  //! Block until all requests made so far have completed.
+  void waitForAll();
+
+private:
+  struct Private;
+  Private* d;
+  friend struct Private;
+};
+
+//##################################################################################################
+//! Read many files concurrently using AsyncFileIO
+/*!
+\param fileNames - The files to read.
+\return The contents of each file in the same order as fileNames, empty if a file could not be read.
+*/
+std::vector<std::string> TP_UTILS_SHARED_EXPORT readFilesBatch(const std::vector<std::string>& fileNames);
+
+}
+
+#endif
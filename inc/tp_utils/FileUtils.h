@@ -11,6 +11,14 @@
 namespace tp_utils
 {
 
+//##################################################################################################
+//! Should a write be flushed through to the storage device before returning.
+enum class SyncToDisk
+{
+  Yes,
+  No
+};
+
 //##################################################################################################
 std::string TP_UTILS_SHARED_EXPORT readTextFile(const std::string& fileName);
 
@@ -20,57 +28,341 @@ std::string TP_UTILS_SHARED_EXPORT readBinaryFile(const std::string& fileName);
 //##################################################################################################
 //! Writes a string to a file
 /*!
+The file is written atomically, see AtomicFileWriter.
+
 \param fileName - The path to the file to write to
 \param textOutput - The text to write out
+\param syncToDisk - Pass Yes to flush the data to disk before returning.
 \return True if the file was written, else false.
  */
-bool TP_UTILS_SHARED_EXPORT writeTextFile(const std::string& fileName, const std::string& textOutput);
+bool TP_UTILS_SHARED_EXPORT writeTextFile(const std::string& fileName, const std::string& textOutput, SyncToDisk syncToDisk=SyncToDisk::No);
 
 //##################################################################################################
 //! Writes a string to a file
 /*!
+The file is written atomically, see AtomicFileWriter.
+
 \param fileName - The path to the file to write to
 \param textOutput - The text to write out
+\param syncToDisk - Pass Yes to flush the data to disk before returning.
 \return True if the file was written, else false.
  */
-bool TP_UTILS_SHARED_EXPORT writeBinaryFile(const std::string& fileName, const std::string& textOutput);
+bool TP_UTILS_SHARED_EXPORT writeBinaryFile(const std::string& fileName, const std::string& textOutput, SyncToDisk syncToDisk=SyncToDisk::No);
 
 //##################################################################################################
+//! Parse a JSON file
+/*!
+On Linux the file is memory mapped and parsed in place, elsewhere it is parsed from a std::ifstream,
+either way the text is never copied into a string.
+
+\param fileName - The path to the file to read.
+\return The parsed JSON or null if the file could not be read or parsed.
+*/
 nlohmann::json TP_UTILS_SHARED_EXPORT readJSONFile(const std::string& fileName);
 
 //##################################################################################################
-bool TP_UTILS_SHARED_EXPORT writeJSONFile(const std::string& fileName, const nlohmann::json& j, int indent = -1);
+//! Parse a JSON file, filtering the DOM as it is built
+/*!
+The callback is called for each element as it is parsed, returning false from the callback will
+discard that element. This can be used to read a small part of a large file without ever holding the
+rest of it in memory.
+
+\param fileName - The path to the file to read.
+\param callback - See nlohmann::json::parser_callback_t.
+\return The parsed JSON or null if the file could not be read or parsed.
+*/
+nlohmann::json TP_UTILS_SHARED_EXPORT readJSONFile(const std::string& fileName, const nlohmann::json::parser_callback_t& callback);
+
+//##################################################################################################
+//! Parse a JSON file passing each event to a SAX handler without building a DOM
+/*!
+\param fileName - The path to the file to read.
+\param sax - The handler that will receive the parse events.
+\return True if the file was read and the whole document was parsed, else false.
+*/
+bool TP_UTILS_SHARED_EXPORT readJSONFileSAX(const std::string& fileName, nlohmann::json::json_sax_t& sax);
+
+//##################################################################################################
+bool TP_UTILS_SHARED_EXPORT writeJSONFile(const std::string& fileName, const nlohmann::json& j, int indent = -1, SyncToDisk syncToDisk=SyncToDisk::No);
+
+//##################################################################################################
+bool TP_UTILS_SHARED_EXPORT writePrettyJSONFile(const std::string& fileName, const nlohmann::json& j, SyncToDisk syncToDisk=SyncToDisk::No);
+
+//##################################################################################################
+//! Encodings supported by readBinaryJSONFile() and writeBinaryJSONFile().
+enum class JSONFormat
+{
+  Auto,        //!< Detect the format when reading, CBOR when writing.
+  Text,        //!< Plain text JSON.
+  CBOR,        //!< RFC 8949, written with the self-describe tag so that it can be detected.
+  MessagePack, //!< Only objects and arrays can be written at the top level.
+  UBJSON       //!< Only objects and arrays can be written at the top level.
+};
+
+//##################################################################################################
+//! Parse a file in one of the binary JSON encodings
+/*!
+The file is memory mapped and decoded in place, as with readJSONFile(). With JSONFormat::Auto the
+encoding is detected from the first few bytes of the file, text JSON is also accepted so this can be
+used to read files regardless of how they were written.
+
+\param fileName - The path to the file to read.
+\param format - The encoding of the file, or Auto to detect it.
+\return The decoded JSON or null if the file could not be read or decoded.
+*/
+nlohmann::json TP_UTILS_SHARED_EXPORT readBinaryJSONFile(const std::string& fileName, JSONFormat format=JSONFormat::Auto);
+
+//##################################################################################################
+//! Encode JSON and write it to a file
+/*!
+The encoded data is streamed into an AtomicFileWriter without building it in memory first.
+
+\param fileName - The path to the file to write to.
+\param j - The JSON to encode.
+\param format - The encoding to use, Auto writes CBOR.
+\param syncToDisk - Pass Yes to flush the data to disk before returning.
+\return True if the file was written, else false.
+*/
+bool TP_UTILS_SHARED_EXPORT writeBinaryJSONFile(const std::string& fileName, const nlohmann::json& j, JSONFormat format=JSONFormat::Auto, SyncToDisk syncToDisk=SyncToDisk::No);
+
+//##################################################################################################
+//! Writes a file via a temporary file that replaces the target when committed.
+/*!
+On Linux the data is written to a temporary file in the same directory as the target using large
+buffered write(2)/writev(2) calls, commit() then renames it over the target. Readers will see either
+the old file or the complete new file, never a partial write. If the writer is destroyed without a
+successful commit() the temporary file is removed and the target is left untouched.
+
+Symlinks are followed so the file they point to is replaced rather than the link. Files that can not
+be replaced without breaking them, hard links and special files such as FIFOs, are truncated and
+written in place instead, see replacementFilePath(), these writes are not atomic.
+
+On other platforms this falls back to writing the target directly with a std::ofstream.
+
+<pre>
+tp_utils::AtomicFileWriter writer(path, true);
+writer.write(header.data(), header.size());
+writer.write(body.data(), body.size());
+if(!writer.commit())
+  tpWarning() << "Failed to write: " << path;
+</pre>
+*/
+class TP_UTILS_SHARED_EXPORT AtomicFileWriter
+{
+  TP_NONCOPYABLE(AtomicFileWriter);
+public:
+  //################################################################################################
+  /*!
+  \param fileName - The path to the file to write to.
+  \param binary - False to open in text mode, this only makes a difference on some platforms.
+  \param syncToDisk - Pass Yes to fdatasync the file and its directory during commit().
+  */
+  AtomicFileWriter(const std::string& fileName, bool binary, SyncToDisk syncToDisk=SyncToDisk::No);
+
+  //################################################################################################
+  //! Discards the temporary file if commit() has not been called.
+  ~AtomicFileWriter();
+
+  //################################################################################################
+  //! Returns false if the file could not be opened or a previous write failed.
+  bool isOK() const;
+
+  //################################################################################################
+  //! Append data to the file, small writes are buffered.
+  bool write(const char* data, size_t size);
+
+  //################################################################################################
+  //! Flush all data and move the file into place.
+  /*!
+  \return True if every write succeeded and the target has been replaced, else false.
+  */
+  bool commit();
+
+private:
+  struct Private;
+  Private* d;
+  friend struct Private;
+};
+
+//##################################################################################################
+//! Returns the permission bits to give a file that is written to replace fileName
+/*!
+If fileName exists its permissions are returned so that replacing it does not change them, otherwise
+this returns 0666 masked by the process umask, the same as a file created with std::ofstream.
+*/
+int TP_UTILS_SHARED_EXPORT replacementFileMode(const std::string& fileName);
 
 //##################################################################################################
-bool TP_UTILS_SHARED_EXPORT writePrettyJSONFile(const std::string& fileName, const nlohmann::json& j);
+//! Returns the path to write to when replacing fileName and whether to write it in place
+/*!
+Symlinks are resolved so that the file they point to is replaced rather than the link itself. Files
+that are not regular files, such as FIFOs or /dev/null, regular files with more than one hard link,
+and dangling symlinks can not be replaced without breaking them. For these inPlace is set and the file
+should be truncated and written directly, as std::ofstream would. On other platforms inPlace is
+always set.
+
+\param fileName - The path of the file that is going to be written.
+\param inPlace - Set to true if the file should be written in place rather than replaced.
+eturn The path to write to.
+*/
+std::string TP_UTILS_SHARED_EXPORT replacementFilePath(const std::string& fileName, bool& inPlace);
 
 //##################################################################################################
-//!
+//! Writes a JSON document to a file element by element without building a DOM
 /*!
+Each value is serialized straight into an AtomicFileWriter, so only the value currently being
+written needs to be held in memory. Commas, colons and indentation are inserted automatically.
+
+<pre>
+tp_utils::JSONStreamWriter writer(path);
+writer.beginObject();
+writer.key("results");
+writer.beginArray();
+for(const auto& result : results)
+  writer.value(result.toJSON());
+writer.end();
+writer.end();
+if(!writer.commit())
+  tpWarning() << "Failed to write: " << path;
+</pre>
+
+Calls made in an invalid order (a value in an object without a key, a key in an array, unbalanced
+end() calls) put the writer into an error state and commit() will return false.
+*/
+class TP_UTILS_SHARED_EXPORT JSONStreamWriter
+{
+  TP_NONCOPYABLE(JSONStreamWriter);
+public:
+  //################################################################################################
+  /*!
+  \param fileName - The path to the file to write to.
+  \param indent - The indent to use, or -1 for compact output, as with nlohmann::json::dump().
+  \param syncToDisk - Pass Yes to flush the data to disk during commit().
+  */
+  JSONStreamWriter(const std::string& fileName, int indent=-1, SyncToDisk syncToDisk=SyncToDisk::No);
+
+  //################################################################################################
+  ~JSONStreamWriter();
+
+  //################################################################################################
+  //! Returns false if the file could not be opened or a previous call failed.
+  bool isOK() const;
+
+  //################################################################################################
+  void beginObject();
+
+  //################################################################################################
+  void beginArray();
+
+  //################################################################################################
+  //! Close the most recent object or array.
+  void end();
+
+  //################################################################################################
+  //! Write the key for the next value, only valid inside an object.
+  void key(const std::string& key);
+
+  //################################################################################################
+  //! Write a complete value.
+  void value(const nlohmann::json& j);
+
+  //################################################################################################
+  //! Flush all data and move the file into place.
+  /*!
+  \return True if a single complete document was written and the target replaced, else false.
+  */
+  bool commit();
+
+private:
+  struct Private;
+  Private* d;
+  friend struct Private;
+};
+
+//##################################################################################################
+//! List the files in a directory
+/*!
+This calls listFilesCallback if it is set, otherwise on Linux this is implemented by reading the
+directory with getdents64.
+
 \param path The directory to list file in.
-\param extensions File extensions to search in the format "*.png".
+\param extensions File extensions to search in the format "*.png", or empty for all files.
 \return A list of absolute paths.
 */
 std::vector<std::string> TP_UTILS_SHARED_EXPORT listFiles(const std::string& path, const std::unordered_set<std::string>& extensions);
 
 //##################################################################################################
+//! Details of a file found by scanFiles().
+struct FileInfo
+{
+  std::string path;  //!< The absolute path to the file.
+  int64_t size{0};   //!< The size in bytes, only set if metadata was requested.
+  int64_t timeMS{0}; //!< The modification time in ms since the epoch, only set if metadata was requested.
+};
+
+//##################################################################################################
+//! Recursively search a directory tree for files
+/*!
+On Linux the directory tree is walked in parallel, each thread takes a directory from a shared queue,
+reads it with getdents64, and queues the sub directories that it finds. Symlinks to directories are
+not followed. Files are passed to the callback as each directory is finished, calls to the callback
+are serialized but may come from any of the worker threads. This returns once the whole tree has
+been scanned.
+
+On other platforms, or if listFilesCallback or listDirectoriesCallback are set, this falls back to
+calling listFiles() and listDirectories() for each directory on the calling thread.
+
+\param path - The directory to scan.
+\param extensions - File extensions to search in the format "*.png", or empty for all files.
+\param callback - Called for each file found.
+\param collectMetadata - True to fill in the size and time of each file using statx.
+\param threads - The number of threads to use, or 0 to use one per core.
+*/
+void TP_UTILS_SHARED_EXPORT scanFiles(const std::string& path,
+                                     const std::unordered_set<std::string>& extensions,
+                                     const std::function<void(const FileInfo&)>& callback,
+                                     bool collectMetadata=false,
+                                     size_t threads=0);
+
+//##################################################################################################
+//! List the sub directories of a directory as absolute paths
 std::vector<std::string> listDirectories(const std::string& path);
 
 //##################################################################################################
+//! Returns the modification time of a file in ms since the epoch, or 0
 int64_t fileTimeMS(const std::string& path);
 
 //##################################################################################################
+//! Copy a file, replacing pathTo if it exists
+/*!
+On Linux the copy is done in the kernel using copy_file_range, falling back to sendfile. The data is
+copied into a temporary file that is renamed over pathTo, so pathTo is never left partially written.
+Copying a file onto itself, including through another link to it, does nothing and returns true.
+*/
 bool copyFile(const std::string& pathFrom, const std::string& pathTo);
 
 //##################################################################################################
+//! Create a directory
+/*!
+\param path - The directory to create.
+\param createFullPath - Yes to create parent directories as well, this will then also return true if
+the directory already exists.
+*/
 bool mkdir(const std::string& path, CreateFullPath createFullPath);
 
 //##################################################################################################
+//! Remove a file or directory, recursive removes the contents of directories without following links
 bool rm(const std::string& path, bool recursive);
 
 //##################################################################################################
 bool exists(const std::string& path);
 
+//##################################################################################################
+//! Optional callbacks that replace the built in implementations of the methods above.
+/*!
+These are used on platforms where there is no built in implementation, or where the application
+wants to provide its own, for example by using Qt.
+*/
 //##################################################################################################
 extern std::vector<std::string> (*listFilesCallback)(const std::string& path, const std::unordered_set<std::string>& extensions);
 extern std::vector<std::string> (*listDirectoriesCallback)(const std::string& path);
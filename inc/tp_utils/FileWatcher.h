@@ -0,0 +1,76 @@
+#ifndef tp_utils_FileWatcher_h
+#define tp_utils_FileWatcher_h
+
+#include "tp_utils/CallbackCollection.h"
+
+namespace tp_utils
+{
+class AbstractCrossThreadCallbackFactory;
+
+//##################################################################################################
+//! Watches files and directories for changes
+/*!
+On Linux this uses a single inotify fd for all of the watched paths. Each path is watched through
+its parent directory so that files that are replaced by a rename (as writeTextFile() does) continue
+to be tracked, directories are also watched directly so that changes to their contents are reported.
+If a parent directory is removed its paths are reported as changed and are watched again once it is
+recreated.
+On other platforms the paths are polled using fileTimeMS().
+
+Changes are debounced, a path is reported once no further events have been seen for it for
+debounceMS.
+
+If a crossThreadCallbackFactory is provided changed is called on the thread that the factory
+delivers callbacks to, otherwise it is called on the watcher thread. Connect to changed before
+adding paths.
+
+<pre>
+tp_utils::PolledCrossThreadCallbackFactory factory;
+tp_utils::FileWatcher watcher(100, &factory);
+tp_utils::Callback<void(const std::string&)> configChanged([&](const std::string& path){...});
+configChanged.connect(watcher.changed);
+watcher.addPath("/etc/myapp/config.json");
+...
+factory.poll();
+</pre>
+*/
+class TP_UTILS_SHARED_EXPORT FileWatcher
+{
+  TP_NONCOPYABLE(FileWatcher);
+public:
+  //################################################################################################
+  /*!
+  \param debounceMS - How long a path must be quiet before it is reported as changed.
+  \param crossThreadCallbackFactory - Optional factory used to deliver changed to another thread.
+  */
+  FileWatcher(int64_t debounceMS=100, AbstractCrossThreadCallbackFactory* crossThreadCallbackFactory=nullptr);
+
+  //################################################################################################
+  ~FileWatcher();
+
+  //################################################################################################
+  //! Start watching a file or directory, the path does not need to exist yet.
+  /*!
+  \return False if the path could not be watched, for example if its parent directory is missing.
+  */
+  bool addPath(const std::string& path);
+
+  //################################################################################################
+  void removePath(const std::string& path);
+
+  //################################################################################################
+  std::vector<std::string> paths() const;
+
+  //################################################################################################
+  //! Called with the path as it was passed to addPath() once changes to it have settled.
+  CallbackCollection<void(const std::string&)> changed;
+
+private:
+  struct Private;
+  Private* d;
+  friend struct Private;
+};
+
+}
+
+#endif
@@ -0,0 +1,583 @@
+#ifndef tp_utils_FlatHashMap_h
+#define tp_utils_FlatHashMap_h
+
+#include "tp_utils/Globals.h"
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+
+namespace tp_utils
+{
+
+namespace detail
+{
+//##################################################################################################
+//! Spread the bits of a hash, std::hash returns integers and pointers unchanged on most platforms.
+inline size_t mixHash(size_t hash)
+{
+  uint64_t x = uint64_t(hash);
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  return size_t(x);
+}
+
+//##################################################################################################
+struct MapKeyOf
+{
+  template<typename P>
+  const auto& operator()(const P& p) const
+  {
+    return p.first;
+  }
+};
+
+//##################################################################################################
+struct SetKeyOf
+{
+  template<typename K>
+  const K& operator()(const K& k) const
+  {
+    return k;
+  }
+};
+
+//##################################################################################################
+//! The open addressing table shared by FlatHashMap and FlatHashSet
+/*!
+Values are stored inline in a single array with a parallel array of control bytes. A control byte
+is either empty, deleted, or the top 7 bits of the hash with the high bit set, so most mismatches
+during a probe are rejected without touching the value. Collisions are resolved with linear probing.
+Erased slots are marked as deleted so that erasing never moves other values, which keeps iterators
+to other values valid. Inserting can rehash, which invalidates all iterators and references.
+*/
+template<typename Key, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+class FlatHashTable
+{
+  static constexpr uint8_t emptySlot=0;
+  static constexpr uint8_t deletedSlot=1;
+  static constexpr uint8_t fullSlot=0x80;
+  static constexpr size_t npos=size_t(-1);
+
+  uint8_t* m_ctrl{nullptr};
+  Value* m_slots{nullptr};
+  size_t m_capacity{0};
+  size_t m_size{0};
+  size_t m_deleted{0};
+  Hash m_hash;
+  KeyEqual m_equal;
+
+public:
+  using key_type = Key;
+  using value_type = Value;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+  using hasher = Hash;
+  using key_equal = KeyEqual;
+  using reference = Value&;
+  using const_reference = const Value&;
+
+  //################################################################################################
+  template<bool IsConst>
+  class Iterator
+  {
+    friend class FlatHashTable;
+    template<bool> friend class Iterator;
+    using Table = std::conditional_t<IsConst, const FlatHashTable, FlatHashTable>;
+
+    Table* m_table{nullptr};
+    size_t m_index{0};
+
+    //##############################################################################################
+    Iterator(Table* table, size_t index):
+      m_table(table),
+      m_index(index)
+    {
+      while(m_index<m_table->m_capacity && m_table->m_ctrl[m_index]<fullSlot)
+        m_index++;
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = Value;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = std::conditional_t<IsConst, const Value*, Value*>;
+    using reference         = std::conditional_t<IsConst, const Value&, Value&>;
+
+    //##############################################################################################
+    Iterator()=default;
+
+    //##############################################################################################
+    operator Iterator<true>() const
+    {
+      return Iterator<true>(m_table, m_index);
+    }
+
+    //##############################################################################################
+    reference operator*() const
+    {
+      return m_table->m_slots[m_index];
+    }
+
+    //##############################################################################################
+    pointer operator->() const
+    {
+      return m_table->m_slots + m_index;
+    }
+
+    //##############################################################################################
+    Iterator& operator++()
+    {
+      *this = Iterator(m_table, m_index+1);
+      return *this;
+    }
+
+    //##############################################################################################
+    Iterator operator++(int)
+    {
+      Iterator i=*this;
+      ++(*this);
+      return i;
+    }
+
+    //##############################################################################################
+    template<bool B>
+    bool operator==(const Iterator<B>& other) const
+    {
+      return m_index == other.m_index;
+    }
+
+    //##############################################################################################
+    template<bool B>
+    bool operator!=(const Iterator<B>& other) const
+    {
+      return m_index != other.m_index;
+    }
+  };
+
+  using iterator = Iterator<false>;
+  using const_iterator = Iterator<true>;
+
+  //################################################################################################
+  FlatHashTable()=default;
+
+  //################################################################################################
+  FlatHashTable(const FlatHashTable& other):
+    m_hash(other.m_hash),
+    m_equal(other.m_equal)
+  {
+    if(!other.m_size)
+      return;
+
+    //Deleted slots are copied too, they may lie on the probe sequence of values placed after them.
+    allocate(other.m_capacity);
+    for(size_t i=0; i<m_capacity; i++)
+    {
+      if(other.m_ctrl[i]>=fullSlot)
+      {
+        new (m_slots+i) Value(other.m_slots[i]);
+        m_size++;
+      }
+      m_ctrl[i] = other.m_ctrl[i];
+    }
+    m_deleted = other.m_deleted;
+  }
+
+  //################################################################################################
+  FlatHashTable(FlatHashTable&& other) noexcept
+  {
+    swap(other);
+  }
+
+  //################################################################################################
+  FlatHashTable& operator=(FlatHashTable other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  //################################################################################################
+  ~FlatHashTable()
+  {
+    destroyAll();
+    deallocate();
+  }
+
+  //################################################################################################
+  void swap(FlatHashTable& other) noexcept
+  {
+    std::swap(m_ctrl, other.m_ctrl);
+    std::swap(m_slots, other.m_slots);
+    std::swap(m_capacity, other.m_capacity);
+    std::swap(m_size, other.m_size);
+    std::swap(m_deleted, other.m_deleted);
+    std::swap(m_hash, other.m_hash);
+    std::swap(m_equal, other.m_equal);
+  }
+
+  //################################################################################################
+  iterator begin(){return iterator(this, 0);}
+  const_iterator begin() const{return const_iterator(this, 0);}
+  const_iterator cbegin() const{return const_iterator(this, 0);}
+
+  //################################################################################################
+  iterator end(){return iterator(this, m_capacity);}
+  const_iterator end() const{return const_iterator(this, m_capacity);}
+  const_iterator cend() const{return const_iterator(this, m_capacity);}
+
+  //################################################################################################
+  size_t size() const{return m_size;}
+  bool empty() const{return m_size==0;}
+  size_t capacity() const{return m_capacity;}
+
+  //################################################################################################
+  iterator find(const Key& key)
+  {
+    return iterator(this, findIndex(key));
+  }
+
+  //################################################################################################
+  const_iterator find(const Key& key) const
+  {
+    return const_iterator(this, findIndex(key));
+  }
+
+  //################################################################################################
+  size_t count(const Key& key) const
+  {
+    return findIndex(key)!=m_capacity?1:0;
+  }
+
+  //################################################################################################
+  bool contains(const Key& key) const
+  {
+    return findIndex(key)!=m_capacity;
+  }
+
+  //################################################################################################
+  size_t erase(const Key& key)
+  {
+    size_t index = findIndex(key);
+    if(index==m_capacity)
+      return 0;
+
+    eraseIndex(index);
+    return 1;
+  }
+
+  //################################################################################################
+  //! Erase the value at i and return an iterator to the next value.
+  iterator erase(const_iterator i)
+  {
+    eraseIndex(i.m_index);
+    return iterator(this, i.m_index+1);
+  }
+
+  //################################################################################################
+  void clear()
+  {
+    destroyAll();
+    if(m_ctrl)
+      std::memset(m_ctrl, emptySlot, m_capacity);
+    m_size = 0;
+    m_deleted = 0;
+  }
+
+  //################################################################################################
+  //! Make space for count values without rehashing.
+  void reserve(size_t count)
+  {
+    size_t capacity = requiredCapacity(count);
+    if(capacity>m_capacity)
+      rehash(capacity);
+  }
+
+protected:
+  //################################################################################################
+  //! Find key or construct a value from args if it is not present.
+  /*!
+  \return The index of the value and true if it was inserted.
+  */
+  template<typename... Args>
+  std::pair<size_t, bool> emplaceKey(const Key& key, Args&&... args)
+  {
+    if(size_t index = findIndex(key); index!=m_capacity)
+      return {index, false};
+
+    if(m_size+m_deleted+1 > maxLoad(m_capacity))
+      rehash(requiredCapacity(m_size+1));
+
+    size_t hash = detail::mixHash(m_hash(key));
+    size_t mask = m_capacity-1;
+    size_t index = hash & mask;
+    while(m_ctrl[index]>=fullSlot)
+      index = (index+1) & mask;
+
+    new (m_slots+index) Value(std::forward<Args>(args)...);
+
+    if(m_ctrl[index]==deletedSlot)
+      m_deleted--;
+
+    m_ctrl[index] = tag(hash);
+    m_size++;
+    return {index, true};
+  }
+
+  //################################################################################################
+  Value& slot(size_t index)
+  {
+    return m_slots[index];
+  }
+
+  //################################################################################################
+  const Value& slot(size_t index) const
+  {
+    return m_slots[index];
+  }
+
+  //################################################################################################
+  size_t findIndex(const Key& key) const
+  {
+    if(!m_size)
+      return m_capacity;
+
+    size_t hash = detail::mixHash(m_hash(key));
+    uint8_t t = tag(hash);
+    size_t mask = m_capacity-1;
+    for(size_t index = hash & mask;; index = (index+1) & mask)
+    {
+      uint8_t c = m_ctrl[index];
+      if(c==emptySlot)
+        return m_capacity;
+
+      if(c==t && m_equal(KeyOf()(m_slots[index]), key))
+        return index;
+    }
+  }
+
+private:
+  //################################################################################################
+  static uint8_t tag(size_t hash)
+  {
+    return uint8_t(fullSlot | (hash >> (sizeof(size_t)*8-7)));
+  }
+
+  //################################################################################################
+  //! Keep at least a quarter of the slots empty so that probes stay short and always terminate.
+  static size_t maxLoad(size_t capacity)
+  {
+    return capacity - capacity/4;
+  }
+
+  //################################################################################################
+  static size_t requiredCapacity(size_t count)
+  {
+    size_t capacity=8;
+    while(maxLoad(capacity)<count)
+      capacity*=2;
+    return capacity;
+  }
+
+  //################################################################################################
+  void allocate(size_t capacity)
+  {
+    m_slots = std::allocator<Value>().allocate(capacity);
+    m_ctrl = new uint8_t[capacity]();
+    m_capacity = capacity;
+  }
+
+  //################################################################################################
+  void deallocate()
+  {
+    if(m_slots)
+      std::allocator<Value>().deallocate(m_slots, m_capacity);
+    delete[] m_ctrl;
+    m_slots = nullptr;
+    m_ctrl = nullptr;
+    m_capacity = 0;
+  }
+
+  //################################################################################################
+  void destroyAll()
+  {
+    for(size_t i=0; i<m_capacity; i++)
+      if(m_ctrl[i]>=fullSlot)
+        m_slots[i].~Value();
+  }
+
+  //################################################################################################
+  void eraseIndex(size_t index)
+  {
+    m_slots[index].~Value();
+    m_size--;
+
+    // If the next slot is empty no probe sequence passes through this one, so it can be emptied.
+    if(m_ctrl[(index+1) & (m_capacity-1)]==emptySlot)
+      m_ctrl[index] = emptySlot;
+    else
+    {
+      m_ctrl[index] = deletedSlot;
+      m_deleted++;
+    }
+  }
+
+  //################################################################################################
+  void rehash(size_t capacity)
+  {
+    FlatHashTable table;
+    table.m_hash = m_hash;
+    table.m_equal = m_equal;
+    table.allocate(capacity);
+
+    size_t mask = capacity-1;
+    for(size_t i=0; i<m_capacity; i++)
+    {
+      if(m_ctrl[i]<fullSlot)
+        continue;
+
+      size_t hash = detail::mixHash(m_hash(KeyOf()(m_slots[i])));
+      size_t index = hash & mask;
+      while(table.m_ctrl[index]!=emptySlot)
+        index = (index+1) & mask;
+
+      new (table.m_slots+index) Value(std::move_if_noexcept(m_slots[i]));
+      table.m_ctrl[index] = tag(hash);
+      table.m_size++;
+    }
+
+    swap(table);
+  }
+};
+}
+
+//##################################################################################################
+//! An open addressing hash map that stores its values in a single flat array
+/*!
+This has the same interface as std::unordered_map for the common operations and works with the
+container helpers in Globals.h such as tpGetMapValue() and tpContainsKey(). Unlike std::unordered_map
+inserting can move existing values, so references and iterators are invalidated by inserts.
+value_type is std::pair<Key, T> rather than std::pair<const Key, T>, the key must not be modified.
+*/
+template<typename Key, typename T, typename Hash=std::hash<Key>, typename KeyEqual=std::equal_to<Key>>
+class FlatHashMap : public detail::FlatHashTable<Key, std::pair<Key, T>, detail::MapKeyOf, Hash, KeyEqual>
+{
+  using Base = detail::FlatHashTable<Key, std::pair<Key, T>, detail::MapKeyOf, Hash, KeyEqual>;
+public:
+  using mapped_type = T;
+  using typename Base::value_type;
+  using typename Base::iterator;
+  using typename Base::const_iterator;
+
+  //################################################################################################
+  FlatHashMap()=default;
+
+  //################################################################################################
+  FlatHashMap(std::initializer_list<value_type> values)
+  {
+    this->reserve(values.size());
+    for(const auto& value : values)
+      insert(value);
+  }
+
+  //################################################################################################
+  T& operator[](const Key& key)
+  {
+    return this->slot(this->emplaceKey(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple()).first).second;
+  }
+
+  //################################################################################################
+  T& at(const Key& key)
+  {
+    size_t index = this->findIndex(key);
+    if(index==this->capacity())
+      throw std::out_of_range("FlatHashMap::at");
+    return this->slot(index).second;
+  }
+
+  //################################################################################################
+  const T& at(const Key& key) const
+  {
+    size_t index = this->findIndex(key);
+    if(index==this->capacity())
+      throw std::out_of_range("FlatHashMap::at");
+    return this->slot(index).second;
+  }
+
+  //################################################################################################
+  std::pair<iterator, bool> insert(const value_type& value)
+  {
+    auto r = this->emplaceKey(value.first, value);
+    return {iterator(this->find(value.first)), r.second};
+  }
+
+  //################################################################################################
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args)
+  {
+    auto r = this->emplaceKey(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    return {this->find(key), r.second};
+  }
+
+  //################################################################################################
+  template<typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)
+  {
+    value_type value(std::forward<Args>(args)...);
+    auto r = this->emplaceKey(value.first, std::move(value));
+    return {this->find(this->slot(r.first).first), r.second};
+  }
+};
+
+//##################################################################################################
+//! An open addressing hash set that stores its values in a single flat array, see FlatHashMap.
+template<typename Key, typename Hash=std::hash<Key>, typename KeyEqual=std::equal_to<Key>>
+class FlatHashSet : public detail::FlatHashTable<Key, Key, detail::SetKeyOf, Hash, KeyEqual>
+{
+  using Base = detail::FlatHashTable<Key, Key, detail::SetKeyOf, Hash, KeyEqual>;
+public:
+  using typename Base::value_type;
+  using typename Base::iterator;
+  using typename Base::const_iterator;
+
+  //################################################################################################
+  FlatHashSet()=default;
+
+  //################################################################################################
+  FlatHashSet(std::initializer_list<Key> values)
+  {
+    this->reserve(values.size());
+    for(const auto& value : values)
+      insert(value);
+  }
+
+  //################################################################################################
+  std::pair<iterator, bool> insert(const Key& key)
+  {
+    auto r = this->emplaceKey(key, key);
+    return {this->find(key), r.second};
+  }
+
+  //################################################################################################
+  std::pair<iterator, bool> insert(Key&& key)
+  {
+    size_t index = this->findIndex(key);
+    if(index!=this->capacity())
+      return {this->find(key), false};
+
+    auto r = this->emplaceKey(key, std::move(key));
+    return {this->find(this->slot(r.first)), true};
+  }
+
+  //################################################################################################
+  template<typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args)
+  {
+    return insert(Key(std::forward<Args>(args)...));
+  }
+};
+
+}
+
+#endif
@@ -5,7 +5,10 @@
 
 #include <functional>
 
+#include <cstring>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <random>
 #include <algorithm>
@@ -108,10 +111,33 @@ T tpMax(T a, T b)
 }
 
 //##################################################################################################
-std::string tpFromHEX(const std::string& input);
+//! Decode hex, both upper and lower case digits are accepted.
+/*!
+\return The decoded bytes, or an empty string if the input has an odd length or invalid characters.
+*/
+std::string tpFromHEX(std::string_view input);
+
+//##################################################################################################
+//! Decode hex into a preallocated buffer.
+/*!
+\param input - The hex to decode, upper and lower case digits are accepted.
+\param output - Space for input.size()/2 bytes.
+\return False if the input has an odd length or invalid characters, output will be partly written.
+*/
+bool tpFromHEX(std::string_view input, void* output);
+
+//##################################################################################################
+//! Encode bytes as upper case hex.
+std::string tpToHex(std::string_view input);
 
 //##################################################################################################
-std::string tpToHex(const std::string& input);
+//! Encode bytes as upper case hex into a preallocated buffer.
+/*!
+\param input - The bytes to encode.
+\param size - The number of bytes to encode.
+\param output - Space for 2*size chars, no null terminator is written.
+*/
+void tpToHex(const void* input, size_t size, char* output);
 
 //##################################################################################################
 //! Returns true if input starts with the string in s
@@ -162,6 +188,210 @@ void tpSplit(std::vector<std::string>& result,
              char del,
              tp_utils::SplitBehavior behavior=tp_utils::SplitBehavior::KeepEmptyParts);
 
+namespace tp_utils
+{
+//##################################################################################################
+//! Returns a pointer to the first c in [begin, end) or end if there is none.
+/*!
+This uses memchr which the C library implements with SIMD, scanning 16 or 32 bytes per step.
+*/
+inline const char* findChar(const char* begin, const char* end, char c)
+{
+  //memchr must not be passed a null pointer, which an empty string_view may hold.
+  if(begin == end)
+    return end;
+
+  auto found = static_cast<const char*>(std::memchr(begin, c, size_t(end-begin)));
+  return found?found:end;
+}
+
+//##################################################################################################
+//! A lazy range over the parts of a string split on a delimiter
+/*!
+The parts are views into the input, nothing is copied or allocated, so the input and a string
+delimiter must outlive the iteration. Iterators do not refer back to the SplitView so they remain
+valid after a temporary SplitView is destroyed. Parts are produced in the same way as tpSplit() does,
+an empty delimiter yields the whole input as a single part.
+
+<pre>
+for(std::string_view field : tpSplitView(line, ','))
+  ...
+</pre>
+*/
+class SplitView
+{
+public:
+  //################################################################################################
+  //! The delimiter and split behavior, copied into each iterator.
+  struct Delimiter
+  {
+    std::string_view del;
+    char delChar{0};
+    bool singleChar{false};
+    SplitBehavior behavior{SplitBehavior::KeepEmptyParts};
+
+    //##############################################################################################
+    const char* find(const char* begin, const char* end) const
+    {
+      if(singleChar)
+        return findChar(begin, end, delChar);
+
+      if(del.empty())
+        return end;
+
+      auto i = std::string_view(begin, size_t(end-begin)).find(del);
+      return (i==std::string_view::npos)?end:(begin+i);
+    }
+
+    //##############################################################################################
+    size_t size() const
+    {
+      return singleChar?1:del.size();
+    }
+  };
+
+  //################################################################################################
+  class Iterator
+  {
+    friend class SplitView;
+    Delimiter m_delimiter;
+    const char* m_begin{nullptr};
+    const char* m_partEnd{nullptr};
+    const char* m_end{nullptr};
+    bool m_done{true};
+
+    //##############################################################################################
+    Iterator(std::string_view input, const Delimiter& delimiter):
+      m_delimiter(delimiter),
+      m_begin(input.data()),
+      m_end(input.data()+input.size()),
+      m_done(false)
+    {
+      m_partEnd = m_delimiter.find(m_begin, m_end);
+      skipEmpty();
+    }
+
+    //##############################################################################################
+    void next()
+    {
+      if(m_partEnd == m_end)
+      {
+        m_done = true;
+        return;
+      }
+
+      m_begin = m_partEnd + m_delimiter.size();
+      m_partEnd = m_delimiter.find(m_begin, m_end);
+    }
+
+    //##############################################################################################
+    void skipEmpty()
+    {
+      if(m_delimiter.behavior == SplitBehavior::SkipEmptyParts)
+        while(!m_done && m_begin == m_partEnd)
+          next();
+    }
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = std::string_view;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = const std::string_view*;
+    using reference         = std::string_view;
+
+    //##############################################################################################
+    Iterator()=default;
+
+    //##############################################################################################
+    std::string_view operator*() const
+    {
+      return std::string_view(m_begin, size_t(m_partEnd-m_begin));
+    }
+
+    //##############################################################################################
+    Iterator& operator++()
+    {
+      next();
+      skipEmpty();
+      return *this;
+    }
+
+    //##############################################################################################
+    Iterator operator++(int)
+    {
+      Iterator i=*this;
+      ++(*this);
+      return i;
+    }
+
+    //##############################################################################################
+    bool operator==(const Iterator& other) const
+    {
+      return (m_done && other.m_done) || (m_done == other.m_done && m_begin == other.m_begin);
+    }
+
+    //##############################################################################################
+    bool operator!=(const Iterator& other) const
+    {
+      return !(*this == other);
+    }
+  };
+
+  //################################################################################################
+  SplitView(std::string_view input, char del, SplitBehavior behavior=SplitBehavior::KeepEmptyParts):
+    m_input(input)
+  {
+    m_delimiter.delChar = del;
+    m_delimiter.singleChar = true;
+    m_delimiter.behavior = behavior;
+  }
+
+  //################################################################################################
+  SplitView(std::string_view input, std::string_view del, SplitBehavior behavior=SplitBehavior::KeepEmptyParts):
+    m_input(input)
+  {
+    m_delimiter.del = del;
+    m_delimiter.delChar = del.size()==1?del.front():0;
+    m_delimiter.singleChar = del.size()==1;
+    m_delimiter.behavior = behavior;
+  }
+
+  //################################################################################################
+  Iterator begin() const
+  {
+    return Iterator(m_input, m_delimiter);
+  }
+
+  //################################################################################################
+  Iterator end() const
+  {
+    return Iterator();
+  }
+
+private:
+  std::string_view m_input;
+  Delimiter m_delimiter;
+};
+}
+
+//##################################################################################################
+//! Split a string on a delimiter without copying, see tp_utils::SplitView.
+inline tp_utils::SplitView tpSplitView(std::string_view input,
+                                       char del,
+                                       tp_utils::SplitBehavior behavior=tp_utils::SplitBehavior::KeepEmptyParts)
+{
+  return tp_utils::SplitView(input, del, behavior);
+}
+
+//##################################################################################################
+//! Split a string on a delimiter without copying, see tp_utils::SplitView.
+inline tp_utils::SplitView tpSplitView(std::string_view input,
+                                       std::string_view del,
+                                       tp_utils::SplitBehavior behavior=tp_utils::SplitBehavior::KeepEmptyParts)
+{
+  return tp_utils::SplitView(input, del, behavior);
+}
+
 //##################################################################################################
 //! Remove all instances of a character from a string.
 void tpRemoveChar(std::string& s, char c);
@@ -272,11 +502,77 @@ typename T::mapped_type tpGetMapValue(const T& map,
   return (i != map.end())?(i->second):defaultValue;
 }
 
+namespace tp_utils
+{
+//##################################################################################################
+enum class UTFError
+{
+  None,              //!< The input was valid.
+  InvalidByte,       //!< A UTF-8 byte that can not start a sequence.
+  Truncated,         //!< A UTF-8 sequence that is missing continuation bytes.
+  Overlong,          //!< A UTF-8 sequence that uses more bytes than needed.
+  Surrogate,         //!< A UTF-8 sequence that encodes a UTF-16 surrogate.
+  TooLarge,          //!< A UTF-8 sequence that encodes a value above U+10FFFF.
+  UnpairedSurrogate  //!< A UTF-16 surrogate that is not part of a pair.
+};
+
+//##################################################################################################
+struct UTFResult
+{
+  UTFError error{UTFError::None}; //!< The first error found.
+  size_t position{0};             //!< The input position of the error, or the input size.
+  size_t written{0};              //!< The number of output code units written.
+};
+
+//##################################################################################################
+//! The number of UTF-16 code units needed to hold valid UTF-8 input.
+size_t utf16LengthFromUTF8(const char* input, size_t size);
+
 //##################################################################################################
-std::string tpToUTF8(const std::u16string& source);
+//! The number of UTF-8 bytes needed to hold valid UTF-16 input.
+size_t utf8LengthFromUTF16(const char16_t* input, size_t size);
 
 //##################################################################################################
-std::u16string tpFromUTF8(const std::string& source);
+//! Validate and convert UTF-8 to UTF-16.
+/*!
+Runs of ASCII are converted with SIMD where available, everything else is validated and converted a
+code point at a time. Conversion stops at the first error.
+
+\param input - The UTF-8 to convert.
+\param size - The number of bytes in input.
+\param output - Space for at least utf16LengthFromUTF8(input, size) code units.
+\return The error, if any, and the number of code units written.
+*/
+UTFResult convertUTF8ToUTF16(const char* input, size_t size, char16_t* output);
+
+//##################################################################################################
+//! Validate and convert UTF-16 to UTF-8.
+/*!
+\param input - The UTF-16 to convert.
+\param size - The number of code units in input.
+\param output - Space for at least utf8LengthFromUTF16(input, size) bytes.
+\return The error, if any, and the number of bytes written.
+*/
+UTFResult convertUTF16ToUTF8(const char16_t* input, size_t size, char* output);
+}
+
+//##################################################################################################
+//! Convert UTF-16 to UTF-8.
+/*!
+\param source - The UTF-16 to convert.
+\param result - Optional, set to the result of the conversion.
+\return The UTF-8 or an empty string if the source was not valid UTF-16.
+*/
+std::string tpToUTF8(std::u16string_view source, tp_utils::UTFResult* result=nullptr);
+
+//##################################################################################################
+//! Convert UTF-8 to UTF-16.
+/*!
+\param source - The UTF-8 to convert.
+\param result - Optional, set to the result of the conversion.
+\return The UTF-16 or an empty string if the source was not valid UTF-8.
+*/
+std::u16string tpFromUTF8(std::string_view source, tp_utils::UTFResult* result=nullptr);
 
 namespace detail
 {
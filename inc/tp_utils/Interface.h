@@ -2,8 +2,10 @@
 #define tp_utils_Interface_h
 
 #include "tp_utils/StringID.h"
+#include "tp_utils/StringIDMap.h"
+#include "tp_utils/SmallVector.h"
 
-#include <unordered_map>
+#include <typeinfo>
 
 #if defined(TDP_WIN32)
 #undef interface
@@ -12,8 +14,35 @@
 namespace tp_utils
 {
 
+//##################################################################################################
+//! Returns the slot index for a type name, the first type to ask gets 0, the next 1, and so on.
+size_t TP_UTILS_SHARED_EXPORT interfaceSlot(const char* typeName);
+
+//##################################################################################################
+//! Returns the slot index used to store interfaces of type T in an Interface.
+/*!
+The index is assigned on first use and cached, after that this is a single load. Slots are assigned
+by type name rather than per template instance so that each type gets the same slot in every shared
+library.
+*/
+template<class T>
+size_t interfaceSlot()
+{
+  static const size_t slot = interfaceSlot(typeid(T).name());
+  return slot;
+}
+
 //##################################################################################################
 //! This provides a generic way to pass interfaces to different classes.
+/*!
+Interfaces can be stored either by StringID or by type. Lookups by type use a slot index assigned to
+each type and are a load from a flat array, prefer them for interfaces that are looked up often.
+
+<pre>
+interface.set<MyService>(&service);
+MyService* service = interface.find<MyService>();
+</pre>
+*/
 class TP_UTILS_SHARED_EXPORT Interface final
 {
 public:
@@ -38,8 +67,29 @@ public:
     m_interfaces[stringID] = interface;
   }
 
+  //################################################################################################
+  //! Find the interface of type T or nullptr if one has not been set.
+  template<class T>
+  T* find()const
+  {
+    size_t slot = interfaceSlot<T>();
+    return (slot<m_slots.size())?static_cast<T*>(m_slots[slot]):nullptr;
+  }
+
+  //################################################################################################
+  //! Set the interface of type T, pass nullptr to remove it.
+  template<class T>
+  void set(T* interface)
+  {
+    size_t slot = interfaceSlot<T>();
+    if(slot>=m_slots.size())
+      m_slots.resize(slot+1, nullptr);
+    m_slots[slot] = interface;
+  }
+
 private:
-  std::unordered_map<tp_utils::StringID, void*> m_interfaces;
+  tp_utils::StringIDMap<void*> m_interfaces;
+  tp_utils::SmallVector<void*, 8> m_slots;
 };
 
 }
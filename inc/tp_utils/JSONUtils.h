@@ -3,6 +3,12 @@
 
 #include "json.hpp"
 
+#include <algorithm>
+#include <array>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
 #define TPJSON       tp_utils::getJSONValue<nlohmann::json>
 #define TPJSONString tp_utils::getJSONValue<std::string>
 #define TPJSONInt    tp_utils::getJSONValue<int>
@@ -13,36 +19,370 @@
 #define TPJSONBool   tp_utils::getJSONValue<bool>
 #define TPJSONList   tp_utils::getJSONStringList
 #define TPJSONArray  tp_utils::getJSONArray
+#define TPJSONArrayRef tp_utils::getJSONArrayRef
 
 namespace tp_utils
 {
 
 //##################################################################################################
+//! Returns true if j holds a type that can be converted to T without throwing
+/*!
+This returns false for types that it does not know about, tryGetJSONValue() then falls back to
+get<T>() in a try/catch for those. Numeric types other than the json's own integer and float types
+also accept booleans, as get<T>() converts those.
+*/
+template<typename T>
+bool isJSONType(const nlohmann::json& j)
+{
+  if constexpr(std::is_same_v<T, nlohmann::json>)
+    return true;
+  else if constexpr(std::is_same_v<T, bool>)
+    return j.is_boolean();
+  else if constexpr(std::is_same_v<T, nlohmann::json::number_integer_t> ||
+                     std::is_same_v<T, nlohmann::json::number_unsigned_t> ||
+                     std::is_same_v<T, nlohmann::json::number_float_t>)
+    return j.is_number();
+  else if constexpr(std::is_arithmetic_v<T>)
+    return j.is_number() || j.is_boolean();
+  else if constexpr(std::is_same_v<T, std::string>)
+    return j.is_string();
+  else
+    return false;
+}
+
+//##################################################################################################
+//! Returns a pointer to the value for key or nullptr if j is not an object or does not contain key
+inline const nlohmann::json* findJSONValue(const nlohmann::json& j, const std::string& key)
+{
+  if(!j.is_object())
+    return nullptr;
+
+  auto i = j.find(key);
+  return (i!=j.end())?&(*i):nullptr;
+}
+
+//##################################################################################################
+//! Convert j to T, returns false and leaves result unchanged if j holds a different type
+template<typename T>
+bool tryGetJSONValue(const nlohmann::json& j, T& result)
+{
+  if(isJSONType<T>(j))
+  {
+    j.get_to(result);
+    return true;
+  }
+
+  if constexpr(std::is_same_v<T, bool> || std::is_arithmetic_v<T> || std::is_same_v<T, std::string>)
+    return false;
+  else
+  {
+    try
+    {
+      result = j.get<T>();
+      return true;
+    }
+    catch(...)
+    {
+      return false;
+    }
+  }
+}
+
+//##################################################################################################
+//! Get the value for key, returns false and leaves result unchanged if it is missing or mistyped
+template<typename T>
+bool tryGetJSONValue(const nlohmann::json& j, const std::string& key, T& result)
+{
+  const nlohmann::json* v = findJSONValue(j, key);
+  return v && tryGetJSONValue(*v, result);
+}
+
+//##################################################################################################
+//! Get the value for key, returns defaultValue if it is missing or of the wrong type
+/*!
+Common types (bool, numbers, strings, json) are type checked before conversion so that a missing or
+mistyped value does not involve throwing an exception.
+*/
 template<typename T>
 T getJSONValue(const nlohmann::json& j,
                const std::string& key,
                const T& defaultValue=T())
 {
   T result=defaultValue;
+  tryGetJSONValue(j, key, result);
+  return result;
+}
 
-  try
-  {
-    result = j.value<T>(key, defaultValue);
-  }
-  catch(...)
+//##################################################################################################
+//! A key and a reference to the variable to store its value in, see getJSONValues()
+template<typename T>
+struct JSONField
+{
+  std::string_view key;
+  T& value;
+};
+
+//##################################################################################################
+template<typename T>
+JSONField<T> jsonField(std::string_view key, T& value)
+{
+  return {key, value};
+}
+
+//##################################################################################################
+//! Extract several values from an object in a single pass over its members
+/*!
+Fields that are missing or of the wrong type are left unchanged, so initialize them with their
+default values first. The sweep stops as soon as every field has been found.
+
+<pre>
+int x=0;
+std::string name;
+double scale=1.0;
+tp_utils::getJSONValues(j,
+                        tp_utils::jsonField("x", x),
+                        tp_utils::jsonField("name", name),
+                        tp_utils::jsonField("scale", scale));
+</pre>
+
+\return The number of fields that were found and assigned.
+*/
+template<typename... T>
+size_t getJSONValues(const nlohmann::json& j, JSONField<T>... fields)
+{
+  if(!j.is_object())
+    return 0;
+
+  constexpr size_t count = sizeof...(T);
+  size_t found=0;
+  size_t assigned=0;
+
+  for(auto i=j.begin(); i!=j.end() && found<count; ++i)
   {
+    std::string_view key = i.key();
+    auto match = [&](auto& field)
+    {
+      if(key != field.key)
+        return false;
+
+      found++;
+      if(tryGetJSONValue(i.value(), field.value))
+        assigned++;
+      return true;
+    };
+
+    (match(fields) || ...);
   }
 
-  return result;
+  return assigned;
 }
 
 //##################################################################################################
+//! Returns the strings in the array held by key, other types of value are skipped
 std::vector<std::string> getJSONStringList(const nlohmann::json& j,
                                            const std::string& key);
 
 //##################################################################################################
+//! As above but the strings are moved out of j rather than copied
+std::vector<std::string> getJSONStringList(nlohmann::json&& j,
+                                           const std::string& key);
+
+//##################################################################################################
+//! Returns a copy of the array held by key or an empty list
 std::vector<nlohmann::json> getJSONArray(const nlohmann::json& j,
                                          const std::string& key);
+
+//##################################################################################################
+//! As above but the array is moved out of j rather than copied
+std::vector<nlohmann::json> getJSONArray(nlohmann::json&& j,
+                                         const std::string& key);
+
+//##################################################################################################
+//! Returns a reference to the array held by key, or to an empty array, without copying anything
+/*!
+<pre>
+for(const nlohmann::json& item : TPJSONArrayRef(j, "items"))
+  ...
+</pre>
+*/
+const nlohmann::json& getJSONArrayRef(const nlohmann::json& j,
+                                      const std::string& key);
+
+//##################################################################################################
+//! A JSON key and the struct member that it binds to, see TP_JSON_BIND
+template<typename C, typename M>
+struct JSONMember
+{
+  std::string_view key;
+  M C::* member;
+};
+
+//##################################################################################################
+template<typename C, typename M>
+constexpr JSONMember<C, M> jsonMember(std::string_view key, M C::* member)
+{
+  return {key, member};
 }
 
+namespace detail
+{
+//##################################################################################################
+template<typename T, typename = void>
+struct IsJSONBound : std::false_type {};
+
+//##################################################################################################
+template<typename T>
+struct IsJSONBound<T, std::void_t<decltype(tpJSONFields(static_cast<const T*>(nullptr)))>> : std::true_type {};
+
+//##################################################################################################
+template<typename T>
+constexpr auto jsonFields()
+{
+  return tpJSONFields(static_cast<const T*>(nullptr));
+}
+
+//##################################################################################################
+template<typename T>
+constexpr size_t jsonFieldCount()
+{
+  return std::tuple_size_v<decltype(jsonFields<T>())>;
+}
+
+//##################################################################################################
+//! A key and the function that decodes the value for that key into its member.
+template<typename T>
+struct JSONFieldDecoder
+{
+  std::string_view key;
+  void (*decode)(T&, const nlohmann::json&);
+};
+}
+
+//##################################################################################################
+template<typename T>
+void fromJSON(const nlohmann::json& j, T& object);
+
+namespace detail
+{
+//##################################################################################################
+template<typename T, size_t I>
+void decodeJSONField(T& object, const nlohmann::json& value)
+{
+  auto& member = object.*(std::get<I>(jsonFields<T>()).member);
+  using M = std::remove_reference_t<decltype(member)>;
+
+  if constexpr(IsJSONBound<M>::value)
+    fromJSON(value, member);
+  else
+    tryGetJSONValue(value, member);
+}
+
+//##################################################################################################
+//! Build the table of decoders sorted by key so that keys can be found with a binary search.
+template<typename T, size_t... I>
+std::array<JSONFieldDecoder<T>, sizeof...(I)> makeJSONFieldDecoders(std::index_sequence<I...>)
+{
+  std::array<JSONFieldDecoder<T>, sizeof...(I)> decoders{{{std::get<I>(jsonFields<T>()).key, &decodeJSONField<T, I>}...}};
+  std::sort(decoders.begin(), decoders.end(), [](const auto& a, const auto& b){return a.key < b.key;});
+  return decoders;
+}
+}
+
+//##################################################################################################
+//! Serialize a struct that has been bound with TP_JSON_BIND.
+template<typename T>
+nlohmann::json toJSON(const T& object)
+{
+  nlohmann::json j = nlohmann::json::object();
+  std::apply([&](const auto&... field)
+  {
+    ((j[std::string(field.key)] = object.*(field.member)), ...);
+  }, detail::jsonFields<T>());
+  return j;
+}
+
+//##################################################################################################
+//! Deserialize a struct that has been bound with TP_JSON_BIND.
+/*!
+The members of j are visited once and each key is looked up in a table of the bound keys that is
+built and sorted the first time this is called for T. Members that are missing from j or hold the
+wrong type are left unchanged, so the struct's default member values act as defaults.
+*/
+template<typename T>
+void fromJSON(const nlohmann::json& j, T& object)
+{
+  if(!j.is_object())
+    return;
+
+  constexpr size_t count = detail::jsonFieldCount<T>();
+  static const auto decoders = detail::makeJSONFieldDecoders<T>(std::make_index_sequence<count>());
+
+  size_t found=0;
+  for(auto i=j.begin(); i!=j.end() && found<count; ++i)
+  {
+    std::string_view key = i.key();
+    auto d = std::lower_bound(decoders.begin(), decoders.end(), key, [](const auto& a, std::string_view b){return a.key < b;});
+    if(d != decoders.end() && d->key == key)
+    {
+      d->decode(object, i.value());
+      found++;
+    }
+  }
+}
+
+//##################################################################################################
+template<typename T>
+T fromJSON(const nlohmann::json& j)
+{
+  T object;
+  fromJSON(j, object);
+  return object;
+}
+}
+
+//##################################################################################################
+//! Bind the members of a struct to JSON keys
+/*!
+Use this in the same namespace as the struct, after it has been defined. This generates the field
+list used by tp_utils::toJSON() and tp_utils::fromJSON() as well as to_json and from_json functions
+so that nlohmann can serialize the struct directly, including as a member of other bound structs or
+in containers.
+
+<pre>
+namespace my_ns
+{
+struct Point
+{
+  int x{0};
+  int y{0};
+  std::string label{"origin"};
+};
+
+TP_JSON_BIND(Point,
+             TP_JSON_FIELD(x),
+             TP_JSON_FIELD(y),
+             TP_JSON_NAMED_FIELD("name", label));
+}
+
+nlohmann::json j = tp_utils::toJSON(point);
+auto point = tp_utils::fromJSON<my_ns::Point>(j);
+</pre>
+
+\def TP_JSON_BIND(type, ...)
+\param type - The struct to bind.
+\param ... - A list of TP_JSON_FIELD or TP_JSON_NAMED_FIELD.
+*/
+#define TP_JSON_BIND(type, ...) \
+  [[maybe_unused]] inline constexpr auto tpJSONFields(const type*){using TPJSONType = type; return std::make_tuple(__VA_ARGS__);} \
+  [[maybe_unused]] inline void to_json(nlohmann::json& j, const type& o){j = tp_utils::toJSON(o);} \
+  [[maybe_unused]] inline void from_json(const nlohmann::json& j, type& o){tp_utils::fromJSON(j, o);}
+
+//##################################################################################################
+//! Bind a member to a key with the same name, see TP_JSON_BIND
+#define TP_JSON_FIELD(member) tp_utils::jsonMember(#member, &TPJSONType::member)
+
+//##################################################################################################
+//! Bind a member to a key with a different name, see TP_JSON_BIND
+#define TP_JSON_NAMED_FIELD(key, member) tp_utils::jsonMember(key, &TPJSONType::member)
+
 #endif
@@ -0,0 +1,124 @@
+#ifndef tp_utils_PageAllocator_h
+#define tp_utils_PageAllocator_h
+
+#include "tp_utils/PageSize.h"
+
+#include <new>
+
+namespace tp_utils
+{
+
+//##################################################################################################
+enum class HugePages
+{
+  No, //!< Use normal pages.
+  Yes //!< Use huge pages if the system provides them, else normal pages.
+};
+
+//##################################################################################################
+//! Allocate page aligned memory directly from the OS
+/*!
+On Linux with HugePages::Yes this first tries an explicit huge page mapping (MAP_HUGETLB), these come
+from the reserved pool in /proc/sys/vm/nr_hugepages which is often empty. If that fails a mapping
+aligned to the huge page size is made and marked with madvise(MADV_HUGEPAGE) so that transparent huge
+pages can back it, see transparentHugePages(). Huge page allocations are rounded up to a multiple of
+hugePageSize().
+
+If numaNode is not negative the memory is bound to that node with mbind(MPOL_PREFERRED) before it is
+touched, so that pages are allocated there when possible. If the binding fails a warning is printed and
+the memory is returned with the default policy.
+
+The memory is zero initialized. On other platforms this falls back to an aligned operator new and the
+huge page and NUMA arguments are ignored.
+
+\param size - The number of bytes to allocate.
+\param hugePages - Whether to try to back the memory with huge pages.
+\param numaNode - The NUMA node to place the memory on or -1 for the default policy.
+\return The allocated memory or nullptr on failure, free with freePages() using the same arguments.
+*/
+void* TP_UTILS_SHARED_EXPORT allocatePages(size_t size, HugePages hugePages=HugePages::No, int numaNode=-1);
+
+//##################################################################################################
+//! Free memory allocated with allocatePages(), size and hugePages must match the allocation.
+void TP_UTILS_SHARED_EXPORT freePages(void* data, size_t size, HugePages hugePages=HugePages::No);
+
+//##################################################################################################
+//! An STL compatible allocator that uses allocatePages()
+/*!
+Each allocation is made with its own mapping so this is intended for large, long lived containers such
+as lookup tables rather than many small allocations.
+
+<pre>
+std::vector<uint64_t, tp_utils::PageAllocator<uint64_t>> table(1<<24);
+</pre>
+*/
+template<typename T>
+class PageAllocator
+{
+public:
+  using value_type = T;
+
+  HugePages hugePages{HugePages::Yes};
+  int numaNode{-1};
+
+  //################################################################################################
+  PageAllocator(HugePages hugePages_=HugePages::Yes, int numaNode_=-1) noexcept:
+    hugePages(hugePages_),
+    numaNode(numaNode_)
+  {
+
+  }
+
+  //################################################################################################
+  template<typename U>
+  PageAllocator(const PageAllocator<U>& other) noexcept:
+    hugePages(other.hugePages),
+    numaNode(other.numaNode)
+  {
+
+  }
+
+  //################################################################################################
+  //! Returns nullptr for n==0 without allocating, deallocate() accepts it.
+  T* allocate(size_t n)
+  {
+    if(n==0)
+      return nullptr;
+
+    if(n > size_t(-1)/sizeof(T))
+      throw std::bad_array_new_length();
+
+    void* data = allocatePages(n*sizeof(T), hugePages, numaNode);
+    if(!data)
+      throw std::bad_alloc();
+
+    return static_cast<T*>(data);
+  }
+
+  //################################################################################################
+  void deallocate(T* data, size_t n) noexcept
+  {
+    if(!data || n==0)
+      return;
+
+    freePages(data, n*sizeof(T), hugePages);
+  }
+
+  //################################################################################################
+  template<typename U>
+  bool operator==(const PageAllocator<U>& other) const noexcept
+  {
+    return hugePages==other.hugePages && numaNode==other.numaNode;
+  }
+
+  //################################################################################################
+  template<typename U>
+  bool operator!=(const PageAllocator<U>& other) const noexcept
+  {
+    return !(*this == other);
+  }
+};
+
+}
+
+#endif
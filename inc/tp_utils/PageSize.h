@@ -8,47 +8,33 @@ namespace tp_utils
 
 //##################################################################################################
 //! Returns the virtual memory page size or 0
+/*!
+This is read from the auxiliary vector the first time it is called and then cached.
+*/
 size_t TP_UTILS_SHARED_EXPORT pageSize();
 
-}
-
-#ifdef TDP_LINUX //=================================================================================
+//##################################################################################################
+//! Returns the default huge page size or 0 if huge pages are not supported
+/*!
+This is the size used by MAP_HUGETLB without a size flag and by transparent huge pages, typically
+2MB on x86_64. The value is read from /proc/meminfo the first time it is called and then cached.
+*/
+size_t TP_UTILS_SHARED_EXPORT hugePageSize();
 
-#include <sys/mman.h>
-namespace tp_utils
-{
 //##################################################################################################
-inline size_t TP_UTILS_SHARED_EXPORT pageSize()
+//! The system wide transparent huge page mode
+enum class TransparentHugePages
 {
-  size_t n;
-  int u;
-  for (n = 1; n; n *= 2)
-  {
-    char* p = reinterpret_cast<char*>(mmap(nullptr, n * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
-
-    if (p == MAP_FAILED)
-      return 0;
-
-    u = munmap(p + n, n);
-    munmap(p, n * 2);
-
-    if(!u)
-      return n;
-  }
-  return 0;
-}
-}
+  Unavailable, //!< The kernel does not support transparent huge pages.
+  Always,      //!< All suitable anonymous mappings are backed by huge pages.
+  MAdvise,     //!< Only regions marked with madvise(MADV_HUGEPAGE) are backed by huge pages.
+  Never        //!< Transparent huge pages are disabled.
+};
 
-
-#else //============================================================================================
-namespace tp_utils
-{
 //##################################################################################################
-inline size_t TP_UTILS_SHARED_EXPORT pageSize()
-{
-  return 0;
-}
+//! Returns the transparent huge page mode, read from sysfs the first time it is called and cached.
+TransparentHugePages TP_UTILS_SHARED_EXPORT transparentHugePages();
+
 }
-#endif
 
 #endif
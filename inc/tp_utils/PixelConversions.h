@@ -0,0 +1,87 @@
+#ifndef tp_utils_PixelConversions_h
+#define tp_utils_PixelConversions_h
+
+#include "tp_utils/TPPixel.h"
+
+namespace tp_utils
+{
+
+//##################################################################################################
+//! An RGBA pixel with float channels in the range 0 to 1.
+struct TPPixelF
+{
+  float r{0.0f};
+  float g{0.0f};
+  float b{0.0f};
+  float a{1.0f};
+};
+
+//##################################################################################################
+//! A non owning strided view of a 2D block of pixels in any format, see TPPixelView.
+template<typename T>
+struct PixelView
+{
+  T* data{nullptr};
+  size_t width{0};
+  size_t height{0};
+  size_t stride{0}; //!< The distance between the start of each row in elements of T.
+
+  //################################################################################################
+  PixelView()=default;
+
+  //################################################################################################
+  PixelView(T* data_, size_t width_, size_t height_, size_t stride_=0):
+    data(data_),
+    width(width_),
+    height(height_),
+    stride(stride_?stride_:width_)
+  {
+
+  }
+
+  //################################################################################################
+  T* row(size_t y) const
+  {
+    return data + y*stride;
+  }
+};
+
+//##################################################################################################
+//! Convert between TPPixel (RGBA8) and other pixel formats.
+/*!
+Each conversion processes the image a row at a time with SSE2 where available. Large images are split
+into bands of rows that are converted in parallel, threads is the maximum number of threads to use, 0
+for one per core. Images smaller than parallelThreshold() pixels are always converted on the calling
+thread. The source and destination must be the same size.
+
+RGB565 is packed as (r<<11)|(g<<5)|b, gray uses the BT.601 luma weights.
+*/
+void TP_UTILS_SHARED_EXPORT convertToRGB565(const TPPixelView& src, const PixelView<uint16_t>& dst, size_t threads=0);
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT convertFromRGB565(const PixelView<const uint16_t>& src, const TPPixelView& dst, size_t threads=0);
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT convertToGray(const TPPixelView& src, const PixelView<uint8_t>& dst, size_t threads=0);
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT convertFromGray(const PixelView<const uint8_t>& src, const TPPixelView& dst, size_t threads=0);
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT convertToFloat(const TPPixelView& src, const PixelView<TPPixelF>& dst, size_t threads=0);
+
+//##################################################################################################
+//! Values outside 0 to 1 are clamped.
+void TP_UTILS_SHARED_EXPORT convertFromFloat(const PixelView<const TPPixelF>& src, const TPPixelView& dst, size_t threads=0);
+
+//##################################################################################################
+//! Copy swapping red and blue, this converts RGBA to BGRA and back, src and dst can be the same.
+void TP_UTILS_SHARED_EXPORT convertToBGRA(const TPPixelView& src, const TPPixelView& dst, size_t threads=0);
+
+//##################################################################################################
+//! The number of pixels above which conversions are split across threads.
+size_t TP_UTILS_SHARED_EXPORT parallelThreshold();
+
+}
+
+#endif
@@ -2,9 +2,7 @@
 #define tp_utils_RefCount_h
 
 #include "tp_utils/Globals.h"
-#include "tp_utils/StringID.h"
-
-#include <unordered_map>
+#include "tp_utils/StringIDMap.h"
 
 //! Methods related to ref counting of types
 /*!
@@ -80,7 +78,7 @@ public:
   \warning you must lock before using this
   \return A hash of type to count
   */
-  static const std::unordered_map<tp_utils::StringID, InstanceDetails>& instances();
+  static const tp_utils::StringIDMap<InstanceDetails>& instances();
 
   //################################################################################################
   static std::vector<std::string> serialize();
@@ -3,8 +3,10 @@
 
 #include "tp_utils/Globals.h"
 
+#include <memory>
 #include <unordered_map>
-#include <sstream>
+#include <istream>
+#include <streambuf>
 
 namespace tp_utils
 {
@@ -14,24 +16,122 @@ struct Resource
 {
   const char* data{nullptr};
   size_t size{0};
+
+  //! Keeps decompressed data alive while the resource is in use, see addCompressedResource().
+  std::shared_ptr<const std::string> owner;
+
+  //################################################################################################
+  std::string_view view() const
+  {
+    return std::string_view(data, size);
+  }
+};
+
+//##################################################################################################
+//! A read only, seekable stream buffer that reads directly from memory without copying it.
+class ResourceBuffer : public std::streambuf
+{
+public:
+  //################################################################################################
+  ResourceBuffer(const char* data, size_t size);
+
+protected:
+  //################################################################################################
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+
+  //################################################################################################
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
+
+namespace detail
+{
+//##################################################################################################
+//! Holds the buffer so that it is constructed before the std::istream that reads from it.
+struct ResourceStreamBuffer
+{
+  ResourceBuffer buffer;
+
+  //! Keeps decompressed data alive for as long as the stream is reading it.
+  std::shared_ptr<const std::string> owner;
 };
+}
 
 //##################################################################################################
-struct ResourceStream :public std::istringstream
+//! Reads a resource as a stream, the stream reads the resource in place without copying it.
+/*!
+The stream holds a reference to the resource's owner so a decompressed resource remains valid for
+the life of the stream, even if it is evicted from the cache.
+*/
+struct ResourceStream : private detail::ResourceStreamBuffer, public std::istream
 {
   //################################################################################################
   ResourceStream(const Resource& resource);
 };
 
 //##################################################################################################
-std::unordered_map<std::string, Resource>& resources();
+//! Returns a copy of all of the uncompressed resources.
+std::unordered_map<std::string, Resource> resources();
 
 //##################################################################################################
-Resource resource(const std::string& name);
+//! Find a resource by name, returns an empty Resource if it does not exist.
+/*!
+Resources registered before the first lookup, normally all of the statically registered ones, are
+frozen into an immutable hash table at that point, looking these up takes no locks. Resources that
+are added later are held in a separate table protected by a mutex, which is only consulted if the
+frozen table does not hold the name or if it has been replaced. This is safe to call from any thread.
+*/
+Resource resource(std::string_view name);
 
 //##################################################################################################
+//! Register a resource, this is safe to call from any thread, the data is not copied.
 void addResource(const std::string& name,  const char* data, size_t size);
 
+//##################################################################################################
+//! Freeze the resources registered so far, this happens automatically on the first lookup.
+void freezeResources();
+
+//##################################################################################################
+enum class ResourceCompression
+{
+  LZ4, //!< LZ4 block format as produced by LZ4_compress_default(), decompressed internally.
+  Zstd //!< A zstd frame, requires a decompressor to be installed.
+};
+
+//##################################################################################################
+//! Decompress src into dst, return true if exactly dstSize bytes were produced.
+using ResourceDecompressor = std::function<bool(const char* src, size_t srcSize, char* dst, size_t dstSize)>;
+
+//##################################################################################################
+//! Install the decompressor for a compression format.
+/*!
+LZ4 has a built in decompressor, installing one replaces it. For zstd install a function that calls
+ZSTD_decompress() from the application that links libzstd.
+*/
+void setResourceDecompressor(ResourceCompression compression, const ResourceDecompressor& decompressor);
+
+//##################################################################################################
+//! Register a compressed resource, it is decompressed the first time it is requested.
+/*!
+Decompressed resources are held in a cache shared by all threads, when the cache grows beyond its
+limit the least recently used resources are evicted. The Resource returned by resource() holds a
+reference to the decompressed data so eviction never invalidates a resource that is in use.
+
+\param name - The name used to look up the resource.
+\param data - The compressed data, this is not copied and must remain valid.
+\param size - The size of the compressed data.
+\param uncompressedSize - The size of the data once it has been decompressed.
+\param compression - The format of the compressed data.
+*/
+void addCompressedResource(const std::string& name,
+                           const char* data,
+                           size_t size,
+                           size_t uncompressedSize,
+                           ResourceCompression compression);
+
+//##################################################################################################
+//! Set the maximum number of bytes of decompressed resources to cache, the default is 64MB.
+void setResourceCacheLimit(size_t bytes);
+
 }
 
 #endif
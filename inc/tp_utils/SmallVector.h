@@ -0,0 +1,376 @@
+#ifndef tp_utils_SmallVector_h
+#define tp_utils_SmallVector_h
+
+#include "tp_utils/Globals.h"
+
+#include <memory>
+#include <stdexcept>
+
+namespace tp_utils
+{
+
+//##################################################################################################
+//! A vector that stores up to N values inline before it allocates
+/*!
+This has the same interface as std::vector for the common operations and works with the container
+helpers in Globals.h such as tpRemoveOne() and tpTakeLast(). It is intended for short lists that are
+created often, where the allocation would cost more than the work done on the list. Moving a
+SmallVector that is using its inline storage moves each value, so iterators are not preserved.
+*/
+template<typename T, size_t N>
+class SmallVector
+{
+  static_assert(N>0, "SmallVector requires inline capacity, use std::vector instead.");
+
+  T* m_data{reinterpret_cast<T*>(m_inline)};
+  size_t m_size{0};
+  size_t m_capacity{N};
+  alignas(T) unsigned char m_inline[N*sizeof(T)];
+
+public:
+  using value_type = T;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = const T&;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  //################################################################################################
+  SmallVector()=default;
+
+  //################################################################################################
+  explicit SmallVector(size_t count, const T& value=T())
+  {
+    reserve(count);
+    std::uninitialized_fill_n(m_data, count, value);
+    m_size = count;
+  }
+
+  //################################################################################################
+  SmallVector(std::initializer_list<T> values)
+  {
+    append(values.begin(), values.end());
+  }
+
+  //################################################################################################
+  template<typename InputIt, typename = std::enable_if_t<!std::is_integral_v<InputIt>>>
+  SmallVector(InputIt first, InputIt last)
+  {
+    append(first, last);
+  }
+
+  //################################################################################################
+  SmallVector(const SmallVector& other)
+  {
+    append(other.begin(), other.end());
+  }
+
+  //################################################################################################
+  SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+  {
+    takeFrom(other);
+  }
+
+  //################################################################################################
+  SmallVector& operator=(const SmallVector& other)
+  {
+    if(this != &other)
+    {
+      clear();
+      append(other.begin(), other.end());
+    }
+    return *this;
+  }
+
+  //################################################################################################
+  SmallVector& operator=(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>)
+  {
+    if(this != &other)
+    {
+      clear();
+      freeHeap();
+      takeFrom(other);
+    }
+    return *this;
+  }
+
+  //################################################################################################
+  SmallVector& operator=(std::initializer_list<T> values)
+  {
+    clear();
+    append(values.begin(), values.end());
+    return *this;
+  }
+
+  //################################################################################################
+  ~SmallVector()
+  {
+    clear();
+    freeHeap();
+  }
+
+  //################################################################################################
+  iterator begin(){return m_data;}
+  const_iterator begin() const{return m_data;}
+  const_iterator cbegin() const{return m_data;}
+
+  //################################################################################################
+  iterator end(){return m_data+m_size;}
+  const_iterator end() const{return m_data+m_size;}
+  const_iterator cend() const{return m_data+m_size;}
+
+  //################################################################################################
+  T* data(){return m_data;}
+  const T* data() const{return m_data;}
+
+  //################################################################################################
+  size_t size() const{return m_size;}
+  bool empty() const{return m_size==0;}
+  size_t capacity() const{return m_capacity;}
+
+  //################################################################################################
+  //! Returns true if the values are stored inline rather than in an allocation.
+  bool isInline() const{return m_data==reinterpret_cast<const T*>(m_inline);}
+
+  //################################################################################################
+  T& operator[](size_t index){return m_data[index];}
+  const T& operator[](size_t index) const{return m_data[index];}
+
+  //################################################################################################
+  T& at(size_t index)
+  {
+    if(index>=m_size)
+      throw std::out_of_range("SmallVector::at");
+    return m_data[index];
+  }
+
+  //################################################################################################
+  const T& at(size_t index) const
+  {
+    if(index>=m_size)
+      throw std::out_of_range("SmallVector::at");
+    return m_data[index];
+  }
+
+  //################################################################################################
+  T& front(){return m_data[0];}
+  const T& front() const{return m_data[0];}
+
+  //################################################################################################
+  T& back(){return m_data[m_size-1];}
+  const T& back() const{return m_data[m_size-1];}
+
+  //################################################################################################
+  void reserve(size_t capacity)
+  {
+    if(capacity>m_capacity)
+      reallocate(capacity);
+  }
+
+  //################################################################################################
+  template<typename... Args>
+  T& emplace_back(Args&&... args)
+  {
+    if(m_size<m_capacity)
+    {
+      new (m_data+m_size) T(std::forward<Args>(args)...);
+      return m_data[m_size++];
+    }
+
+    // Construct the new value before moving the old ones, args may refer to a value in this vector.
+    size_t capacity = m_capacity*2;
+    T* data = std::allocator<T>().allocate(capacity);
+    try
+    {
+      new (data+m_size) T(std::forward<Args>(args)...);
+    }
+    catch(...)
+    {
+      std::allocator<T>().deallocate(data, capacity);
+      throw;
+    }
+
+    moveTo(data, capacity);
+    return m_data[m_size++];
+  }
+
+  //################################################################################################
+  void push_back(const T& value)
+  {
+    emplace_back(value);
+  }
+
+  //################################################################################################
+  void push_back(T&& value)
+  {
+    emplace_back(std::move(value));
+  }
+
+  //################################################################################################
+  void pop_back()
+  {
+    m_size--;
+    m_data[m_size].~T();
+  }
+
+  //################################################################################################
+  template<typename... Args>
+  iterator emplace(const_iterator pos, Args&&... args)
+  {
+    size_t index = size_t(pos-m_data);
+    if(index==m_size)
+    {
+      emplace_back(std::forward<Args>(args)...);
+      return m_data+index;
+    }
+
+    T value(std::forward<Args>(args)...);
+    emplace_back(std::move(back()));
+    std::move_backward(m_data+index, m_data+m_size-2, m_data+m_size-1);
+    m_data[index] = std::move(value);
+    return m_data+index;
+  }
+
+  //################################################################################################
+  iterator insert(const_iterator pos, const T& value)
+  {
+    return emplace(pos, value);
+  }
+
+  //################################################################################################
+  iterator insert(const_iterator pos, T&& value)
+  {
+    return emplace(pos, std::move(value));
+  }
+
+  //################################################################################################
+  iterator erase(const_iterator pos)
+  {
+    return erase(pos, pos+1);
+  }
+
+  //################################################################################################
+  iterator erase(const_iterator first, const_iterator last)
+  {
+    T* f = m_data + (first-m_data);
+    T* l = m_data + (last-m_data);
+    if(f!=l)
+    {
+      T* e = std::move(l, end(), f);
+      std::destroy(e, end());
+      m_size = size_t(e-m_data);
+    }
+    return f;
+  }
+
+  //################################################################################################
+  void clear()
+  {
+    std::destroy(m_data, m_data+m_size);
+    m_size = 0;
+  }
+
+  //################################################################################################
+  void resize(size_t count)
+  {
+    if(count<m_size)
+      erase(m_data+count, end());
+    else
+    {
+      reserve(count);
+      std::uninitialized_value_construct(m_data+m_size, m_data+count);
+      m_size = count;
+    }
+  }
+
+  //################################################################################################
+  void resize(size_t count, const T& value)
+  {
+    if(count<m_size)
+      erase(m_data+count, end());
+    else
+    {
+      while(m_size<count)
+        emplace_back(value);
+    }
+  }
+
+  //################################################################################################
+  bool operator==(const SmallVector& other) const
+  {
+    return m_size==other.m_size && std::equal(begin(), end(), other.begin());
+  }
+
+  //################################################################################################
+  bool operator!=(const SmallVector& other) const
+  {
+    return !(*this==other);
+  }
+
+private:
+  //################################################################################################
+  template<typename InputIt>
+  void append(InputIt first, InputIt last)
+  {
+    if constexpr(std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<InputIt>::iterator_category>)
+      reserve(m_size + size_t(std::distance(first, last)));
+
+    for(; first!=last; ++first)
+      emplace_back(*first);
+  }
+
+  //################################################################################################
+  void reallocate(size_t capacity)
+  {
+    T* data = std::allocator<T>().allocate(capacity);
+    moveTo(data, capacity);
+  }
+
+  //################################################################################################
+  //! Move the values into a new allocation and release the old storage.
+  void moveTo(T* data, size_t capacity)
+  {
+    std::uninitialized_move(m_data, m_data+m_size, data);
+    std::destroy(m_data, m_data+m_size);
+    freeHeap();
+    m_data = data;
+    m_capacity = capacity;
+  }
+
+  //################################################################################################
+  void freeHeap()
+  {
+    if(!isInline())
+      std::allocator<T>().deallocate(m_data, m_capacity);
+    m_data = reinterpret_cast<T*>(m_inline);
+    m_capacity = N;
+  }
+
+  //################################################################################################
+  //! Take the values from other, this must be empty and inline, other is left empty.
+  void takeFrom(SmallVector& other)
+  {
+    if(other.isInline())
+    {
+      std::uninitialized_move(other.m_data, other.m_data+other.m_size, m_data);
+      m_size = other.m_size;
+      other.clear();
+    }
+    else
+    {
+      m_data = other.m_data;
+      m_size = other.m_size;
+      m_capacity = other.m_capacity;
+      other.m_data = reinterpret_cast<T*>(other.m_inline);
+      other.m_size = 0;
+      other.m_capacity = N;
+    }
+  }
+};
+
+}
+
+#endif
@@ -40,6 +40,13 @@ public:
   //! Copy another string id
   StringID(const StringID& other);
 
+  //################################################################################################
+  //! Take the reference from another string id, leaving it invalid
+  /*!
+  This does not touch the reference count or any mutex, so containers can move StringID's cheaply.
+  */
+  StringID(StringID&& other) noexcept;
+
   //################################################################################################
   //! Fetch a string id from a manager
   /*!
@@ -79,6 +86,10 @@ public:
   //! Copy another StringID
   StringID& operator=(const StringID& other);
 
+  //################################################################################################
+  //! Take the reference from another StringID, leaving it invalid
+  StringID& operator=(StringID&& other) noexcept;
+
   //################################################################################################
   //! Decrement the reference count and clean up
   virtual ~StringID();
@@ -106,6 +117,29 @@ public:
   //! Returns true if this points to a valid key
   bool isValid()const;
 
+  //################################################################################################
+  //! Returns a small dense index that identifies this string while it is in use
+  /*!
+  Each distinct string is given an index when it is first used, the index is recycled once the last
+  StringID referencing the string is destroyed. This is used to build tables indexed by StringID
+  that do not need to hash, see StringIDMap.
+
+  \return The index of this string or 0 if this is an invalid StringID, valid indexes start at 1.
+  */
+  size_t index()const;
+
+  //################################################################################################
+  //! Returns the StringID that is currently using index, or an invalid StringID.
+  static StringID fromIndex(size_t index);
+
+  //################################################################################################
+  //! Returns the StringID for each index, this only takes the lock once.
+  static std::vector<StringID> fromIndexes(const std::vector<size_t>& indexes);
+
+  //################################################################################################
+  //! Returns one more than the largest index that has been assigned.
+  static size_t indexCount();
+
   //################################################################################################
   static std::vector<std::string> toStringList(const std::vector<StringID>& stringIDs);
 
@@ -0,0 +1,183 @@
+#ifndef tp_utils_StringIDMap_h
+#define tp_utils_StringIDMap_h
+
+#include "tp_utils/StringID.h"
+
+#include <stdexcept>
+#include <tuple>
+
+namespace tp_utils
+{
+
+//##################################################################################################
+//! A map keyed by StringID that is indexed by StringID::index() rather than hashed
+/*!
+This is a sparse set, values are stored packed in a vector in insertion order and a second vector
+indexed by StringID::index() holds the position of each value. A lookup is a bounds check and two
+array reads. The map holds a reference to each key so an index can't be recycled while it is in use.
+
+Erasing moves the last value into the erased position, so iteration order is not preserved across
+erase and iterators to the last value are invalidated. Inserting can reallocate the values.
+
+This has the same interface as std::unordered_map for the common operations and works with the
+container helpers in Globals.h such as tpGetMapValue() and tpContainsKey().
+*/
+template<typename T>
+class StringIDMap
+{
+  //index -> position in m_values + 1, 0 means not present
+  std::vector<size_t> m_positions;
+  std::vector<std::pair<StringID, T>> m_values;
+
+public:
+  using key_type = StringID;
+  using mapped_type = T;
+  using value_type = std::pair<StringID, T>;
+  using size_type = size_t;
+  using iterator = typename std::vector<value_type>::iterator;
+  using const_iterator = typename std::vector<value_type>::const_iterator;
+
+  //################################################################################################
+  iterator begin(){return m_values.begin();}
+  const_iterator begin() const{return m_values.begin();}
+  const_iterator cbegin() const{return m_values.cbegin();}
+
+  //################################################################################################
+  iterator end(){return m_values.end();}
+  const_iterator end() const{return m_values.end();}
+  const_iterator cend() const{return m_values.cend();}
+
+  //################################################################################################
+  size_t size() const{return m_values.size();}
+  bool empty() const{return m_values.empty();}
+
+  //################################################################################################
+  void reserve(size_t count)
+  {
+    m_values.reserve(count);
+  }
+
+  //################################################################################################
+  void clear()
+  {
+    m_positions.clear();
+    m_values.clear();
+  }
+
+  //################################################################################################
+  iterator find(const StringID& key)
+  {
+    size_t position = positionOf(key.index());
+    return position?(m_values.begin()+std::ptrdiff_t(position-1)):m_values.end();
+  }
+
+  //################################################################################################
+  const_iterator find(const StringID& key) const
+  {
+    size_t position = positionOf(key.index());
+    return position?(m_values.cbegin()+std::ptrdiff_t(position-1)):m_values.cend();
+  }
+
+  //################################################################################################
+  size_t count(const StringID& key) const
+  {
+    return positionOf(key.index())?1:0;
+  }
+
+  //################################################################################################
+  bool contains(const StringID& key) const
+  {
+    return positionOf(key.index())!=0;
+  }
+
+  //################################################################################################
+  T& operator[](const StringID& key)
+  {
+    return try_emplace(key).first->second;
+  }
+
+  //################################################################################################
+  T& at(const StringID& key)
+  {
+    size_t position = positionOf(key.index());
+    if(!position)
+      throw std::out_of_range("StringIDMap::at");
+    return m_values[position-1].second;
+  }
+
+  //################################################################################################
+  const T& at(const StringID& key) const
+  {
+    size_t position = positionOf(key.index());
+    if(!position)
+      throw std::out_of_range("StringIDMap::at");
+    return m_values[position-1].second;
+  }
+
+  //################################################################################################
+  template<typename... Args>
+  std::pair<iterator, bool> try_emplace(const StringID& key, Args&&... args)
+  {
+    size_t index = key.index();
+    if(size_t position = positionOf(index); position)
+      return {m_values.begin()+std::ptrdiff_t(position-1), false};
+
+    if(index>=m_positions.size())
+      m_positions.resize(index+1, 0);
+
+    m_values.emplace_back(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+    m_positions[index] = m_values.size();
+    return {m_values.end()-1, true};
+  }
+
+  //################################################################################################
+  std::pair<iterator, bool> insert(const value_type& value)
+  {
+    return try_emplace(value.first, value.second);
+  }
+
+  //################################################################################################
+  size_t erase(const StringID& key)
+  {
+    size_t position = positionOf(key.index());
+    if(!position)
+      return 0;
+
+    erasePosition(position-1);
+    return 1;
+  }
+
+  //################################################################################################
+  //! Erase the value at i, the last value is moved into its place and the returned iterator.
+  iterator erase(const_iterator i)
+  {
+    size_t position = size_t(i-m_values.cbegin());
+    erasePosition(position);
+    return m_values.begin()+std::ptrdiff_t(position);
+  }
+
+private:
+  //################################################################################################
+  size_t positionOf(size_t index) const
+  {
+    return (index<m_positions.size())?m_positions[index]:0;
+  }
+
+  //################################################################################################
+  void erasePosition(size_t position)
+  {
+    m_positions[m_values[position].first.index()] = 0;
+
+    if(size_t last = m_values.size()-1; position!=last)
+    {
+      m_values[position] = std::move(m_values[last]);
+      m_positions[m_values[position].first.index()] = position+1;
+    }
+
+    m_values.pop_back();
+  }
+};
+
+}
+
+#endif
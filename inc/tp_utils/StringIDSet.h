@@ -0,0 +1,183 @@
+#ifndef tp_utils_StringIDSet_h
+#define tp_utils_StringIDSet_h
+
+#include "tp_utils/StringID.h"
+
+namespace tp_utils
+{
+
+namespace detail
+{
+//##################################################################################################
+//! One block of 65536 indexes in a StringIDSet, stored either as a sorted array or a bitmap.
+struct StringIDSetContainer
+{
+  static constexpr size_t bitmapWords=1024;
+  static constexpr size_t arrayMax=4096;
+
+  uint16_t key{0};
+  size_t cardinality{0};
+
+  //Sorted low 16 bits of each index, used while there are arrayMax or fewer values.
+  std::vector<uint16_t> array;
+
+  //65536 bits, used once there are more than arrayMax values.
+  std::vector<uint64_t> bitmap;
+
+  //################################################################################################
+  bool isBitmap() const
+  {
+    return !bitmap.empty();
+  }
+
+  //################################################################################################
+  bool operator==(const StringIDSetContainer& other) const;
+};
+
+//##################################################################################################
+inline size_t countTrailingZeros(uint64_t word)
+{
+#ifdef __GNUC__
+  return size_t(__builtin_ctzll(word));
+#else
+  size_t n=0;
+  for(; !(word&1); word>>=1)
+    n++;
+  return n;
+#endif
+}
+}
+
+//##################################################################################################
+//! A set of StringID's stored as a compressed bitmap of StringID::index()
+/*!
+This uses the same layout as a roaring bitmap, indexes are split into blocks of 65536 that are
+stored as a sorted array of 16 bit values while they are sparse and as a bitmap once they are dense.
+Union, intersection, and difference work a block at a time, dense blocks are combined a vector
+register at a time.
+
+The set stores indexes rather than references, the StringID's in a set must be kept alive elsewhere,
+as they are for ids declared with TDP_DECLARE_ID. If a StringID is destroyed while in a set its index
+can be reused by a different string.
+
+<pre>
+tp_utils::StringIDSet wanted{redSID(), largeSID()};
+for(const auto& item : catalog)
+  if(item.tags.includes(wanted))
+    ...
+</pre>
+*/
+class TP_UTILS_SHARED_EXPORT StringIDSet
+{
+public:
+  //################################################################################################
+  StringIDSet()=default;
+
+  //################################################################################################
+  StringIDSet(std::initializer_list<StringID> stringIDs);
+
+  //################################################################################################
+  explicit StringIDSet(const std::vector<StringID>& stringIDs);
+
+  //################################################################################################
+  //! \return True if stringID was not already in the set, invalid StringID's are not added.
+  bool insert(const StringID& stringID);
+
+  //################################################################################################
+  //! \return True if stringID was in the set.
+  bool erase(const StringID& stringID);
+
+  //################################################################################################
+  bool contains(const StringID& stringID) const;
+
+  //################################################################################################
+  size_t count(const StringID& stringID) const;
+
+  //################################################################################################
+  size_t size() const;
+
+  //################################################################################################
+  bool empty() const;
+
+  //################################################################################################
+  void clear();
+
+  //################################################################################################
+  //! Returns true if this and other have at least one StringID in common.
+  bool intersects(const StringIDSet& other) const;
+
+  //################################################################################################
+  //! Returns true if every StringID in other is also in this.
+  bool includes(const StringIDSet& other) const;
+
+  //################################################################################################
+  //! Returns the number of StringID's in both this and other without building the intersection.
+  size_t intersectionSize(const StringIDSet& other) const;
+
+  //################################################################################################
+  //! Returns the indexes in the set in ascending order.
+  std::vector<size_t> indexes() const;
+
+  //################################################################################################
+  //! Returns the StringID's in the set ordered by index.
+  std::vector<StringID> toVector() const;
+
+  //################################################################################################
+  //! Call closure with each index in the set in ascending order.
+  template<typename T>
+  void forEachIndex(const T& closure) const
+  {
+    for(const auto& container : m_containers)
+    {
+      size_t high = size_t(container.key)<<16;
+      if(container.isBitmap())
+      {
+        for(size_t w=0; w<detail::StringIDSetContainer::bitmapWords; w++)
+        {
+          for(uint64_t word = container.bitmap[w]; word; word &= word-1)
+            closure(high | (w<<6) | detail::countTrailingZeros(word));
+        }
+      }
+      else
+      {
+        for(uint16_t low : container.array)
+          closure(high | low);
+      }
+    }
+  }
+
+  //################################################################################################
+  StringIDSet& operator|=(const StringIDSet& other);
+
+  //################################################################################################
+  StringIDSet& operator&=(const StringIDSet& other);
+
+  //################################################################################################
+  StringIDSet& operator-=(const StringIDSet& other);
+
+  //################################################################################################
+  bool operator==(const StringIDSet& other) const;
+
+  //################################################################################################
+  bool operator!=(const StringIDSet& other) const;
+
+private:
+  //Sorted by key.
+  std::vector<detail::StringIDSetContainer> m_containers;
+};
+
+//##################################################################################################
+//! Returns the StringID's that are in either a or b.
+StringIDSet TP_UTILS_SHARED_EXPORT operator|(const StringIDSet& a, const StringIDSet& b);
+
+//##################################################################################################
+//! Returns the StringID's that are in both a and b.
+StringIDSet TP_UTILS_SHARED_EXPORT operator&(const StringIDSet& a, const StringIDSet& b);
+
+//##################################################################################################
+//! Returns the StringID's that are in a but not in b.
+StringIDSet TP_UTILS_SHARED_EXPORT operator-(const StringIDSet& a, const StringIDSet& b);
+
+}
+
+#endif
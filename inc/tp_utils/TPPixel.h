@@ -109,4 +109,203 @@ inline bool operator!= (const TPPixel& a, const TPPixel& b)
   return a.i != b.i;
 }
 
+//##################################################################################################
+//! A non owning view of a 2D block of pixels
+/*!
+Rows are stride pixels apart so a view can refer to part of a larger image.
+*/
+struct TPPixelView
+{
+  TPPixel* data{nullptr};
+  size_t width{0};
+  size_t height{0};
+  size_t stride{0}; //!< The distance between the start of each row in pixels.
+
+  //################################################################################################
+  TPPixelView()=default;
+
+  //################################################################################################
+  TPPixelView(TPPixel* data_, size_t width_, size_t height_, size_t stride_=0):
+    data(data_),
+    width(width_),
+    height(height_),
+    stride(stride_?stride_:width_)
+  {
+
+  }
+
+  //################################################################################################
+  TPPixel* row(size_t y) const
+  {
+    return data + y*stride;
+  }
+
+  //################################################################################################
+  TPPixel& at(size_t x, size_t y) const
+  {
+    return data[y*stride + x];
+  }
+
+  //################################################################################################
+  //! Returns true if there are no gaps between the rows.
+  bool isContiguous() const
+  {
+    return stride==width || height<2;
+  }
+
+  //################################################################################################
+  //! Returns a view of a rectangle within this view, the rectangle must be inside this view.
+  TPPixelView subView(size_t x, size_t y, size_t w, size_t h) const
+  {
+    return TPPixelView(row(y)+x, w, h, stride);
+  }
+};
+
+//##################################################################################################
+//! A contiguous block of pixels that owns its data
+class TPPixelBuffer
+{
+  std::vector<TPPixel> m_pixels;
+  size_t m_width{0};
+  size_t m_height{0};
+
+public:
+  //################################################################################################
+  TPPixelBuffer()=default;
+
+  //################################################################################################
+  TPPixelBuffer(size_t width, size_t height, TPPixel value=TPPixel()):
+    m_pixels(width*height, value),
+    m_width(width),
+    m_height(height)
+  {
+
+  }
+
+  //################################################################################################
+  void resize(size_t width, size_t height, TPPixel value=TPPixel())
+  {
+    m_pixels.resize(width*height, value);
+    m_width = width;
+    m_height = height;
+  }
+
+  //################################################################################################
+  size_t width() const
+  {
+    return m_width;
+  }
+
+  //################################################################################################
+  size_t height() const
+  {
+    return m_height;
+  }
+
+  //################################################################################################
+  size_t size() const
+  {
+    return m_pixels.size();
+  }
+
+  //################################################################################################
+  TPPixel* data()
+  {
+    return m_pixels.data();
+  }
+
+  //################################################################################################
+  const TPPixel* data() const
+  {
+    return m_pixels.data();
+  }
+
+  //################################################################################################
+  TPPixel& at(size_t x, size_t y)
+  {
+    return m_pixels[y*m_width + x];
+  }
+
+  //################################################################################################
+  const TPPixel& at(size_t x, size_t y) const
+  {
+    return m_pixels[y*m_width + x];
+  }
+
+  //################################################################################################
+  TPPixelView view()
+  {
+    return TPPixelView(m_pixels.data(), m_width, m_height, m_width);
+  }
+
+  //################################################################################################
+  std::vector<TPPixel>& pixels()
+  {
+    return m_pixels;
+  }
+
+  //################################################################################################
+  const std::vector<TPPixel>& pixels() const
+  {
+    return m_pixels;
+  }
+};
+
+//##################################################################################################
+//! Bulk operations on pixels.
+/*!
+These use SSE2 where available to process 4 pixels at a time. Each operation has an overload for a
+run of pixels and one for a view that is processed a row at a time.
+*/
+namespace tp_utils
+{
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT fillPixels(TPPixel* pixels, size_t count, TPPixel value);
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT fillPixels(const TPPixelView& view, TPPixel value);
+
+//##################################################################################################
+//! Multiply the color channels by alpha.
+void TP_UTILS_SHARED_EXPORT premultiplyAlpha(TPPixel* pixels, size_t count);
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT premultiplyAlpha(const TPPixelView& view);
+
+//##################################################################################################
+//! Swap the red and blue channels, converting between RGBA and BGRA.
+void TP_UTILS_SHARED_EXPORT swapRedBlue(TPPixel* pixels, size_t count);
+
+//##################################################################################################
+void TP_UTILS_SHARED_EXPORT swapRedBlue(const TPPixelView& view);
+
+//##################################################################################################
+//! Composite src over dst, both must have premultiplied alpha.
+/*!
+dst = src + dst*(255-src.a)/255 for each channel including alpha.
+*/
+void TP_UTILS_SHARED_EXPORT blendPixels(TPPixel* dst, const TPPixel* src, size_t count);
+
+//##################################################################################################
+//! Composite src over dst, the views must be the same size.
+void TP_UTILS_SHARED_EXPORT blendPixels(const TPPixelView& dst, const TPPixelView& src);
+
+//##################################################################################################
+//! Parse many "#RRGGBB" or "#RRGGBBAA" colors.
+/*!
+Both upper and lower case hex digits are accepted, invalid colors are output as TPPixel().
+
+\param colors - The colors to parse.
+\param count - The number of colors.
+\param output - Space for count pixels.
+\return The number of colors that were valid.
+*/
+size_t TP_UTILS_SHARED_EXPORT parseColors(const std::string_view* colors, size_t count, TPPixel* output);
+
+//##################################################################################################
+std::vector<TPPixel> TP_UTILS_SHARED_EXPORT parseColors(const std::vector<std::string>& colors);
+
+}
+
 #endif
@@ -0,0 +1,794 @@
+#include "tp_utils/AsyncFileIO.h"
+#include "tp_utils/FileUtils.h"
+#include "tp_utils/MutexUtils.h"
+
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <thread>
+
+#ifdef TDP_LINUX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+namespace tp_utils
+{
+
+namespace
+{
+
+//##################################################################################################
+struct Request
+{
+  bool write{false};
+  std::string fileName;
+  std::string data;
+  std::function<void(bool, std::string&)> readCallback;
+  std::function<void(bool)> writeCallback;
+
+#ifdef TDP_LINUX
+  enum class Stage
+  {
+    Open,
+    Read,
+    Write
+  };
+
+  Stage stage{Stage::Open};
+  int fd{-1};
+  size_t offset{0};
+  bool knownSize{false};
+  std::string tmpName;
+  mode_t mode{0};
+  bool inPlace{false};
+#endif
+};
+
+//##################################################################################################
+//! Read a file reporting failure, unlike readBinaryFile which returns an empty string.
+bool readWholeFile(const std::string& fileName, std::string& data)
+{
+  try
+  {
+    std::ifstream in(fileName, std::ios::binary);
+    if(!in.is_open())
+      return false;
+
+    in.seekg(0, std::ios::end);
+    auto size = in.tellg();
+    in.clear();
+    in.seekg(0);
+
+    //Files in /proc and the like don't report a size, these are read until EOF.
+    if(size <= 0)
+    {
+      data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+      return !in.bad();
+    }
+
+    data.resize(size_t(size));
+    in.read(data.data(), size);
+    return !in.fail();
+  }
+  catch(...)
+  {
+    return false;
+  }
+}
+
+//##################################################################################################
+//! Process a request synchronously, used by the thread pool.
+bool processRequest(Request& request)
+{
+  if(request.write)
+    return writeBinaryFile(request.fileName, request.data);
+
+  return readWholeFile(request.fileName, request.data);
+}
+
+#ifdef TDP_LINUX
+//##################################################################################################
+//! A minimal wrapper around the io_uring system calls and shared memory rings.
+class IOUring
+{
+  TP_NONCOPYABLE(IOUring);
+
+  int m_fd{-1};
+
+  void* m_sqPtr{MAP_FAILED};
+  size_t m_sqSize{0};
+  void* m_cqPtr{MAP_FAILED};
+  size_t m_cqSize{0};
+  struct io_uring_sqe* m_sqes{static_cast<struct io_uring_sqe*>(MAP_FAILED)};
+  size_t m_sqesSize{0};
+
+  unsigned* m_sqHead{nullptr};
+  unsigned* m_sqTail{nullptr};
+  unsigned* m_sqArray{nullptr};
+  unsigned m_sqMask{0};
+  unsigned m_sqEntries{0};
+
+  unsigned* m_cqHead{nullptr};
+  unsigned* m_cqTail{nullptr};
+  struct io_uring_cqe* m_cqes{nullptr};
+  unsigned m_cqMask{0};
+
+  unsigned m_localTail{0};
+  unsigned m_toSubmit{0};
+
+public:
+  //################################################################################################
+  IOUring()=default;
+
+  //################################################################################################
+  ~IOUring()
+  {
+    if(m_sqes != MAP_FAILED)
+      ::munmap(m_sqes, m_sqesSize);
+
+    if(m_cqPtr != MAP_FAILED && m_cqPtr != m_sqPtr)
+      ::munmap(m_cqPtr, m_cqSize);
+
+    if(m_sqPtr != MAP_FAILED)
+      ::munmap(m_sqPtr, m_sqSize);
+
+    if(m_fd>=0)
+      ::close(m_fd);
+  }
+
+  //################################################################################################
+  //! Create the ring, returns false if io_uring or any of the operations we need are unavailable.
+  bool init(unsigned entries)
+  {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    m_fd = int(::syscall(__NR_io_uring_setup, entries, &p));
+    if(m_fd<0)
+      return false;
+
+    if(!probe())
+      return false;
+
+    m_sqSize = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    m_cqSize = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+
+    bool singleMMap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMMap)
+      m_sqSize = m_cqSize = tpMax(m_sqSize, m_cqSize);
+
+    m_sqPtr = ::mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if(m_sqPtr == MAP_FAILED)
+      return false;
+
+    m_cqPtr = singleMMap?m_sqPtr:(::mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING));
+    if(m_cqPtr == MAP_FAILED)
+      return false;
+
+    m_sqesSize = p.sq_entries*sizeof(struct io_uring_sqe);
+    m_sqes = static_cast<struct io_uring_sqe*>(::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+    if(m_sqes == MAP_FAILED)
+      return false;
+
+    auto sq = static_cast<char*>(m_sqPtr);
+    m_sqHead    = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    m_sqTail    = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    m_sqArray   = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    m_sqMask    = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    m_sqEntries = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+    m_localTail = *m_sqTail;
+
+    auto cq = static_cast<char*>(m_cqPtr);
+    m_cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    m_cqes   = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    m_cqMask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+
+    return true;
+  }
+
+  //################################################################################################
+  unsigned entries() const
+  {
+    return m_sqEntries;
+  }
+
+  //################################################################################################
+  int fd() const
+  {
+    return m_fd;
+  }
+
+  //################################################################################################
+  //! Returns a cleared submission queue entry or nullptr if the queue is full.
+  struct io_uring_sqe* getSQE()
+  {
+    unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+    if(m_localTail - head >= m_sqEntries)
+      return nullptr;
+
+    unsigned index = m_localTail & m_sqMask;
+    m_sqArray[index] = index;
+    struct io_uring_sqe* sqe = m_sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+
+    m_localTail++;
+    m_toSubmit++;
+    return sqe;
+  }
+
+  //################################################################################################
+  //! Submit queued entries and wait for at least waitFor completions.
+  /*!
+  \return False if io_uring_enter failed with an error that retrying will not fix.
+  */
+  bool submitAndWait(unsigned waitFor)
+  {
+    __atomic_store_n(m_sqTail, m_localTail, __ATOMIC_RELEASE);
+
+    for(;;)
+    {
+      unsigned flags = waitFor?IORING_ENTER_GETEVENTS:0;
+      long n = ::syscall(__NR_io_uring_enter, m_fd, m_toSubmit, waitFor, flags, nullptr, 0);
+      if(n<0)
+      {
+        if(errno == EINTR)
+          continue;
+
+        //The completion queue is full, the caller needs to reap completions first.
+        return errno == EBUSY;
+      }
+
+      m_toSubmit -= tpMin(unsigned(n), m_toSubmit);
+      return true;
+    }
+  }
+
+  //################################################################################################
+  //! Call callback(userData, result) for each available completion.
+  template<typename T>
+  void forEachCompletion(const T& callback)
+  {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++)
+    {
+      const struct io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+      uint64_t userData = cqe.user_data;
+      int32_t res = cqe.res;
+
+      //Release the slot before the callback as it may queue further requests.
+      __atomic_store_n(m_cqHead, head+1, __ATOMIC_RELEASE);
+      callback(userData, res);
+    }
+  }
+
+private:
+  //################################################################################################
+  bool probe()
+  {
+    constexpr size_t nOps = 256;
+    std::vector<char> buffer(sizeof(struct io_uring_probe) + nOps*sizeof(struct io_uring_probe_op), 0);
+    auto p = reinterpret_cast<struct io_uring_probe*>(buffer.data());
+
+    if(::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, p, nOps) < 0)
+      return false;
+
+    for(int op : {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_POLL_ADD})
+      if(op > p->last_op || !(p->ops[op].flags & IO_URING_OP_SUPPORTED))
+        return false;
+
+    return true;
+  }
+};
+#endif
+}
+
+//##################################################################################################
+struct AsyncFileIO::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  TPMutex mutex{TPM};
+  TPWaitCondition waitCondition;
+  TPWaitCondition idleCondition;
+  std::deque<Request*> pending;
+  size_t outstanding{0};
+  bool finish{false};
+
+  std::vector<std::thread> threads;
+
+#ifdef TDP_LINUX
+  IOUring ring;
+  std::atomic<bool> usingIOUring{false};
+  int eventFD{-1};
+  size_t maxInFlight{0};
+  size_t inFlight{0};
+  uint64_t eventCount{0};
+  std::atomic<uint64_t> tmpCounter{0};
+#endif
+
+  //################################################################################################
+  Private()=default;
+
+  //################################################################################################
+  ~Private()
+  {
+#ifdef TDP_LINUX
+    if(eventFD>=0)
+      ::close(eventFD);
+#endif
+  }
+
+  //################################################################################################
+  //! Call the callback, delete the request, and let waitForAll know.
+  void complete(Request* request, bool ok)
+  {
+    if(request->write)
+    {
+      if(request->writeCallback)
+        request->writeCallback(ok);
+    }
+    else
+    {
+      if(!ok)
+        request->data.clear();
+
+      if(request->readCallback)
+        request->readCallback(ok, request->data);
+    }
+
+    delete request;
+
+    TP_MUTEX_LOCKER(mutex);
+    outstanding--;
+    if(!outstanding)
+      idleCondition.wakeAll();
+  }
+
+  //################################################################################################
+  void wake()
+  {
+#ifdef TDP_LINUX
+    if(usingIOUring)
+    {
+      uint64_t one=1;
+      while(::write(eventFD, &one, sizeof(one))<0 && errno == EINTR){}
+      return;
+    }
+#endif
+    waitCondition.wakeOne();
+  }
+
+  //################################################################################################
+  void add(Request* request)
+  {
+    {
+      TP_MUTEX_LOCKER(mutex);
+      outstanding++;
+      pending.push_back(request);
+    }
+    wake();
+  }
+
+  //################################################################################################
+  void runThreadPool()
+  {
+    mutex.lock(TPM);
+    for(;;)
+    {
+      while(pending.empty() && !finish)
+        waitCondition.wait(TPMc mutex);
+
+      if(pending.empty())
+        break;
+
+      Request* request = pending.front();
+      pending.pop_front();
+      mutex.unlock(TPM);
+
+      complete(request, processRequest(*request));
+
+      mutex.lock(TPM);
+    }
+    mutex.unlock(TPM);
+  }
+
+#ifdef TDP_LINUX
+  //################################################################################################
+  void queueEventPoll()
+  {
+    struct io_uring_sqe* sqe = ring.getSQE();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = eventFD;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = 0;
+  }
+
+  //################################################################################################
+  //! Queue the operation for the current stage of a request.
+  void queueStage(Request* request)
+  {
+    struct io_uring_sqe* sqe = ring.getSQE();
+    sqe->user_data = uint64_t(reinterpret_cast<uintptr_t>(request));
+
+    switch(request->stage)
+    {
+    case Request::Stage::Open:
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      if(request->write && request->inPlace)
+      {
+        sqe->addr = uint64_t(reinterpret_cast<uintptr_t>(request->fileName.c_str()));
+        sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        sqe->len = 0666;
+      }
+      else if(request->write)
+      {
+        request->tmpName = request->fileName + ".tmp." + std::to_string(::getpid()) + '.' + std::to_string(tmpCounter++);
+        sqe->addr = uint64_t(reinterpret_cast<uintptr_t>(request->tmpName.c_str()));
+        sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+        sqe->len = request->mode;
+      }
+      else
+      {
+        sqe->addr = uint64_t(reinterpret_cast<uintptr_t>(request->fileName.c_str()));
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      }
+      break;
+
+    case Request::Stage::Read:
+    case Request::Stage::Write:
+      sqe->opcode = (request->stage == Request::Stage::Read)?IORING_OP_READ:IORING_OP_WRITE;
+      sqe->fd = request->fd;
+      sqe->addr = uint64_t(reinterpret_cast<uintptr_t>(request->data.data() + request->offset));
+      sqe->len = unsigned(tpMin(request->data.size() - request->offset, size_t(1)<<30));
+      //Files written in place may be FIFOs that can not seek, -1 writes at the current position.
+      sqe->off = request->inPlace?uint64_t(-1):request->offset;
+      break;
+    }
+  }
+
+  //################################################################################################
+  //! Close the file, move a written file into place, and complete the request.
+  void finishRequest(Request* request, bool ok)
+  {
+    inFlight--;
+
+    if(request->fd>=0)
+      ok = (::close(request->fd) == 0) && ok;
+
+    if(request->write && !request->tmpName.empty())
+    {
+      ok = ok && (::rename(request->tmpName.c_str(), request->fileName.c_str()) == 0);
+      if(!ok)
+        ::unlink(request->tmpName.c_str());
+    }
+
+    complete(request, ok);
+  }
+
+  //################################################################################################
+  //! Handle a completion and move the request on to its next stage.
+  void advance(Request* request, int32_t res)
+  {
+    if(res == -EINTR || res == -EAGAIN)
+    {
+      queueStage(request);
+      return;
+    }
+
+    if(res<0)
+    {
+      if(request->stage == Request::Stage::Open)
+        request->tmpName.clear();
+      finishRequest(request, false);
+      return;
+    }
+
+    switch(request->stage)
+    {
+    case Request::Stage::Open:
+      request->fd = res;
+      if(request->write)
+      {
+        //openat applies the umask to the mode, set it exactly to match the file being replaced.
+        if(!request->inPlace && ::fchmod(request->fd, request->mode) != 0)
+        {
+          finishRequest(request, false);
+          return;
+        }
+
+        if(request->data.empty())
+        {
+          finishRequest(request, true);
+          return;
+        }
+        request->stage = Request::Stage::Write;
+      }
+      else
+      {
+        //fstat on an open fd never blocks on IO, so it is cheaper to call it here than to submit a
+        //statx that io_uring would hand off to a worker thread. Files in /proc and the like report
+        //a size of 0, these are read in chunks until EOF.
+        struct stat st;
+        if(::fstat(request->fd, &st) != 0)
+        {
+          finishRequest(request, false);
+          return;
+        }
+
+        request->knownSize = st.st_size>0;
+        request->data.resize(request->knownSize?size_t(st.st_size):size_t(64*1024));
+        request->stage = Request::Stage::Read;
+      }
+      break;
+
+    case Request::Stage::Read:
+      if(res == 0)
+      {
+        request->data.resize(request->offset);
+        finishRequest(request, true);
+        return;
+      }
+
+      request->offset += size_t(res);
+      if(request->offset == request->data.size())
+      {
+        if(request->knownSize)
+        {
+          finishRequest(request, true);
+          return;
+        }
+        request->data.resize(request->data.size()*2);
+      }
+      break;
+
+    case Request::Stage::Write:
+      request->offset += size_t(res);
+      if(request->offset == request->data.size())
+      {
+        finishRequest(request, true);
+        return;
+      }
+      break;
+    }
+
+    queueStage(request);
+  }
+
+  //################################################################################################
+  void runIOUring()
+  {
+    queueEventPoll();
+
+    for(;;)
+    {
+      bool finished=false;
+      {
+        TP_MUTEX_LOCKER(mutex);
+        while(!pending.empty() && inFlight<maxInFlight)
+        {
+          inFlight++;
+          queueStage(pending.front());
+          pending.pop_front();
+        }
+
+        finished = finish && pending.empty() && inFlight==0;
+      }
+
+      if(finished)
+        break;
+
+      if(!ring.submitAndWait(1))
+      {
+        failRing();
+        runThreadPool();
+        return;
+      }
+
+      ring.forEachCompletion([&](uint64_t userData, int32_t res)
+      {
+        if(userData == 0)
+        {
+          //New requests have been added, clear the eventfd and poll it again.
+          ssize_t n = ::read(eventFD, &eventCount, sizeof(eventCount));
+          TP_UNUSED(n);
+          queueEventPoll();
+          return;
+        }
+
+        advance(reinterpret_cast<Request*>(uintptr_t(userData)), res);
+      });
+    }
+  }
+
+  //################################################################################################
+  //! Give up on the ring after io_uring_enter fails, the thread then serves the thread pool.
+  /*!
+  Pending requests have not been handed to the kernel so they are failed straight away. Requests
+  that are in flight may still be in use by the kernel, so these are reaped without submitting any
+  further stages and failed as they complete.
+  */
+  void failRing()
+  {
+    std::deque<Request*> failed;
+    {
+      TP_MUTEX_LOCKER(mutex);
+      usingIOUring = false;
+      failed.swap(pending);
+    }
+
+    for(Request* request : failed)
+      complete(request, false);
+
+    while(inFlight>0)
+    {
+      struct pollfd pfd{ring.fd(), POLLIN, 0};
+      ::poll(&pfd, 1, 100);
+
+      ring.forEachCompletion([&](uint64_t userData, int32_t res)
+      {
+        if(userData == 0)
+          return;
+
+        auto request = reinterpret_cast<Request*>(uintptr_t(userData));
+        if(request->stage == Request::Stage::Open)
+        {
+          if(res<0)
+            request->tmpName.clear();
+          else
+            request->fd = res;
+        }
+        finishRequest(request, false);
+      });
+    }
+  }
+#endif
+};
+
+//##################################################################################################
+AsyncFileIO::AsyncFileIO(size_t queueDepth, size_t threads):
+  d(new Private())
+{
+#ifdef TDP_LINUX
+  queueDepth = tpBound(size_t(2), queueDepth, size_t(4096));
+  d->eventFD = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if(d->eventFD>=0 && d->ring.init(unsigned(queueDepth)))
+  {
+    //One slot in the ring is always used to poll the eventfd.
+    d->usingIOUring = true;
+    d->maxInFlight = d->ring.entries()-1;
+    d->threads.emplace_back([&]{d->runIOUring();});
+    return;
+  }
+#else
+  TP_UNUSED(queueDepth);
+#endif
+
+  if(threads == 0)
+    threads = tpMax(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+  for(size_t i=0; i<threads; i++)
+    d->threads.emplace_back([&]{d->runThreadPool();});
+}
+
+//##################################################################################################
+AsyncFileIO::~AsyncFileIO()
+{
+  waitForAll();
+
+  {
+    TP_MUTEX_LOCKER(d->mutex);
+    d->finish = true;
+  }
+
+#ifdef TDP_LINUX
+  if(d->usingIOUring)
+    d->wake();
+  else
+#endif
+    d->waitCondition.wakeAll();
+
+  for(auto& thread : d->threads)
+    thread.join();
+
+  delete d;
+}
+
+//##################################################################################################
+bool AsyncFileIO::usingIOUring() const
+{
+#ifdef TDP_LINUX
+  return d->usingIOUring;
+#else
+  return false;
+#endif
+}
+
+//##################################################################################################
+void AsyncFileIO::readFile(const std::string& fileName, const std::function<void(bool ok, std::string& data)>& callback)
+{
+  auto request = new Request();
+  request->fileName = fileName;
+  request->readCallback = callback;
+  d->add(request);
+}
+
+//##################################################################################################
+std::future<std::string> AsyncFileIO::readFile(const std::string& fileName)
+{
+  auto promise = std::make_shared<std::promise<std::string>>();
+  readFile(fileName, [promise](bool, std::string& data)
+  {
+    promise->set_value(std::move(data));
+  });
+  return promise->get_future();
+}
+
+//##################################################################################################
+void AsyncFileIO::writeFile(const std::string& fileName, std::string data, const std::function<void(bool ok)>& callback)
+{
+  auto request = new Request();
+  request->write = true;
+  request->fileName = fileName;
+  request->data = std::move(data);
+  request->writeCallback = callback;
+#ifdef TDP_LINUX
+  request->fileName = replacementFilePath(fileName, request->inPlace);
+  request->mode = mode_t(replacementFileMode(request->fileName));
+#endif
+  d->add(request);
+}
+
+//##################################################################################################
+std::future<bool> AsyncFileIO::writeFile(const std::string& fileName, std::string data)
+{
+  auto promise = std::make_shared<std::promise<bool>>();
+  writeFile(fileName, std::move(data), [promise](bool ok)
+  {
+    promise->set_value(ok);
+  });
+  return promise->get_future();
+}
+
+//##################################################################################################
+void AsyncFileIO::waitForAll()
+{
+  d->mutex.lock(TPM);
+  while(d->outstanding)
+    d->idleCondition.wait(TPMc d->mutex);
+  d->mutex.unlock(TPM);
+}
+
+//##################################################################################################
+std::vector<std::string> readFilesBatch(const std::vector<std::string>& fileNames)
+{
+  std::vector<std::string> results(fileNames.size());
+  if(fileNames.empty())
+    return results;
+
+  AsyncFileIO io(tpMin(fileNames.size()+1, size_t(256)));
+  for(size_t i=0; i<fileNames.size(); i++)
+  {
+    std::string* result = &results[i];
+    io.readFile(fileNames.at(i), [result](bool, std::string& data)
+    {
+      *result = std::move(data);
+    });
+  }
+  io.waitForAll();
+
+  return results;
+}
+
+}
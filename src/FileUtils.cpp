@@ -1,11 +1,591 @@
 #include "tp_utils/FileUtils.h"
+#include "tp_utils/MutexUtils.h"
 
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <streambuf>
+#include <thread>
+
+#ifdef TDP_LINUX
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
 
 namespace tp_utils
 {
 
+namespace
+{
+#ifdef TDP_LINUX
+//##################################################################################################
+//! Writes all of the buffers handling partial writes and interrupts.
+bool writeAll(int fd, struct iovec* iov, int iovcnt)
+{
+  while(iovcnt>0)
+  {
+    ssize_t n = ::writev(fd, iov, iovcnt);
+    if(n<0)
+    {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+
+    auto written = size_t(n);
+    while(iovcnt>0 && written>=iov->iov_len)
+    {
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if(iovcnt>0)
+    {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  return true;
+}
+
+//##################################################################################################
+//! fsync the directory that contains fileName so that a rename is durable.
+bool syncParentDirectory(const std::string& fileName)
+{
+  auto i = fileName.find_last_of('/');
+  std::string directory = (i == std::string::npos)?std::string("."):(i==0?std::string("/"):fileName.substr(0, i));
+
+  int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(fd<0)
+    return false;
+
+  bool ok = (::fsync(fd) == 0);
+  ::close(fd);
+  return ok;
+}
+#endif
+
+//##################################################################################################
+//! Calls parse with the contents of a file without copying it into memory.
+/*!
+On Linux parse is called with a (begin, end) pair of pointers into a read only memory mapping of the
+file, elsewhere it is called with a std::istream. The nlohmann parse functions accept both forms.
+*/
+template<typename R, typename T>
+R parseFile(const std::string& fileName, const R& failed, const T& parse)
+{
+#ifdef TDP_LINUX
+  int fd = ::open(fileName.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd<0)
+    return failed;
+  TP_CLEANUP([&]{::close(fd);});
+
+  struct stat st;
+  if(::fstat(fd, &st) != 0)
+    return failed;
+
+  auto size = size_t(st.st_size);
+  if(size == 0)
+  {
+    const char* empty="";
+    return parse(empty, empty);
+  }
+
+  void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(data == MAP_FAILED)
+    return failed;
+  TP_CLEANUP([&]{::munmap(data, size);});
+
+  ::madvise(data, size, MADV_SEQUENTIAL);
+
+  const char* begin = static_cast<const char*>(data);
+  return parse(begin, begin+size);
+#else
+  std::ifstream in(fileName, std::ios::binary);
+  if(!in.is_open())
+    return failed;
+  return parse(in);
+#endif
+}
+
+//##################################################################################################
+//! A stream buffer that forwards to an AtomicFileWriter.
+/*!
+This lets nlohmann write directly into the file through its std::ostream interface without building
+a string first. An indent can be inserted after each newline so that a value serialized on its own can
+be nested in a document that is already indented, JSON strings escape newlines so this never changes
+the contents of a string.
+*/
+class WriterStreamBuffer : public std::streambuf
+{
+  AtomicFileWriter& m_writer;
+  size_t m_indent{0};
+  char m_buffer[4096];
+
+public:
+  //################################################################################################
+  WriterStreamBuffer(AtomicFileWriter& writer):
+    m_writer(writer)
+  {
+    setp(m_buffer, m_buffer+sizeof(m_buffer));
+  }
+
+  //################################################################################################
+  //! Set the number of spaces to write after each newline.
+  void setIndent(size_t indent)
+  {
+    m_indent = indent;
+  }
+
+protected:
+  //################################################################################################
+  int_type overflow(int_type c) override
+  {
+    if(!flushBuffer())
+      return traits_type::eof();
+
+    if(traits_type::eq_int_type(c, traits_type::eof()))
+      return traits_type::not_eof(c);
+
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+    return c;
+  }
+
+  //################################################################################################
+  int sync() override
+  {
+    return flushBuffer()?0:-1;
+  }
+
+private:
+  //################################################################################################
+  bool flushBuffer()
+  {
+    bool ok = write(pbase(), size_t(pptr()-pbase()));
+    setp(m_buffer, m_buffer+sizeof(m_buffer));
+    return ok;
+  }
+
+  //################################################################################################
+  bool write(const char* data, size_t size)
+  {
+    if(!m_indent)
+      return m_writer.write(data, size);
+
+    static const std::string spaces(64, ' ');
+    const char* end = data+size;
+    while(data<end)
+    {
+      const char* newLine = findChar(data, end, '\n');
+      if(newLine == end)
+        return m_writer.write(data, size_t(end-data));
+
+      if(!m_writer.write(data, size_t(newLine-data)+1))
+        return false;
+      data = newLine+1;
+
+      for(size_t n=m_indent; n;)
+      {
+        size_t c = tpMin(n, spaces.size());
+        if(!m_writer.write(spaces.data(), c))
+          return false;
+        n-=c;
+      }
+    }
+
+    return true;
+  }
+};
+
+//##################################################################################################
+//! Serializes JSON directly into an AtomicFileWriter without building a string first.
+class JSONSerializer
+{
+  WriterStreamBuffer m_buffer;
+  std::ostream m_stream;
+
+public:
+  //################################################################################################
+  JSONSerializer(AtomicFileWriter& writer):
+    m_buffer(writer),
+    m_stream(&m_buffer)
+  {
+
+  }
+
+  //################################################################################################
+  //! Returns the stream, flush() it before writing to the AtomicFileWriter directly.
+  std::ostream& stream()
+  {
+    return m_stream;
+  }
+
+  //################################################################################################
+  //! Same output as j.dump(indent) but starting at the indent level of depth.
+  void dump(const nlohmann::json& j, int indent, size_t depth=0)
+  {
+    m_buffer.setIndent((indent>0)?depth*size_t(indent):0);
+
+    //The stream only pretty prints for a width above 0, dump(0) still breaks lines.
+    if(indent==0)
+      m_stream << j.dump(0);
+    else
+      m_stream << std::setw(indent) << j;
+
+    m_stream.flush();
+  }
+};
+
+//##################################################################################################
+//! The CBOR self-describe tag (55799), written at the start of CBOR files to identify them.
+constexpr uint8_t cborMagic[3]={0xD9, 0xD9, 0xF7};
+
+//##################################################################################################
+bool isUBJSONMarker(uint8_t c)
+{
+  switch(c)
+  {
+  case 'Z': case 'N': case 'T': case 'F': case 'i': case 'U': case 'I': case 'l': case 'L':
+  case 'd': case 'D': case 'C': case 'S': case 'H': case '$': case '#':
+    return true;
+  default:
+    return false;
+  }
+}
+
+//##################################################################################################
+//! Work out the encoding of a JSON file from its first few bytes.
+/*!
+CBOR is identified by its self-describe tag. MessagePack files written by writeBinaryJSONFile start
+with a map or array header, which can not appear at the start of text JSON. UBJSON and text JSON both
+start containers with '{' or '[', so the byte that follows is used to tell them apart.
+*/
+JSONFormat detectJSONFormat(const uint8_t* data, size_t size)
+{
+  if(size>=3 && std::memcmp(data, cborMagic, 3)==0)
+    return JSONFormat::CBOR;
+
+  if(size==0)
+    return JSONFormat::Text;
+
+  uint8_t c = data[0];
+  if((c>=0x80 && c<=0x9F) || (c>=0xDC && c<=0xDF))
+    return JSONFormat::MessagePack;
+
+  size_t i=0;
+  while(i<size && data[i]=='[')
+    i++;
+
+  if(i<size && data[i]=='{')
+    i++;
+  else if(i==0)
+    return JSONFormat::Text;
+
+  return (i<size && isUBJSONMarker(data[i]))?JSONFormat::UBJSON:JSONFormat::Text;
+}
+
+//##################################################################################################
+template<typename... Input>
+nlohmann::json parseJSON(JSONFormat format, const Input&... input)
+{
+  switch(format)
+  {
+  case JSONFormat::Auto:        [[fallthrough]];
+  case JSONFormat::Text:        return nlohmann::json::parse(input...);
+  case JSONFormat::CBOR:        return nlohmann::json::from_cbor(input...);
+  case JSONFormat::MessagePack: return nlohmann::json::from_msgpack(input...);
+  case JSONFormat::UBJSON:      return nlohmann::json::from_ubjson(input...);
+  }
+  return nlohmann::json();
+}
+}
+
+//##################################################################################################
+struct AtomicFileWriter::Private
+{
+  std::string fileName;
+  SyncToDisk syncToDisk;
+  bool ok{false};
+  bool finished{false};
+
+#ifdef TDP_LINUX
+  static constexpr size_t bufferSize{1024*1024};
+  bool inPlace{false};
+  std::string tmpName;
+  int fd{-1};
+  std::vector<char> buffer;
+
+  //################################################################################################
+  bool flush(const char* data=nullptr, size_t size=0)
+  {
+    struct iovec iov[2];
+    int iovcnt=0;
+
+    if(!buffer.empty())
+    {
+      iov[iovcnt].iov_base = buffer.data();
+      iov[iovcnt].iov_len  = buffer.size();
+      iovcnt++;
+    }
+
+    if(size)
+    {
+      iov[iovcnt].iov_base = const_cast<char*>(data);
+      iov[iovcnt].iov_len  = size;
+      iovcnt++;
+    }
+
+    ok = writeAll(fd, iov, iovcnt);
+    buffer.clear();
+    return ok;
+  }
+
+  //################################################################################################
+  void discard()
+  {
+    if(fd>=0)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+
+    if(!tmpName.empty())
+    {
+      ::unlink(tmpName.c_str());
+      tmpName.clear();
+    }
+  }
+#else
+  std::ofstream out;
+#endif
+
+  //################################################################################################
+  Private(const std::string& fileName_, SyncToDisk syncToDisk_):
+    fileName(fileName_),
+    syncToDisk(syncToDisk_)
+  {
+
+  }
+};
+
+//##################################################################################################
+int replacementFileMode(const std::string& fileName)
+{
+#ifdef TDP_LINUX
+  struct stat st;
+  if(::stat(fileName.c_str(), &st) == 0)
+    return int(st.st_mode & 07777);
+
+  //Reading the umask by setting it races with other threads creating files, so prefer /proc.
+  static const mode_t mask = []
+  {
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while(std::getline(in, line))
+      if(tpStartsWith(line, "Umask:"))
+        return mode_t(std::strtoul(line.c_str()+6, nullptr, 8));
+
+    mode_t m = ::umask(022);
+    ::umask(m);
+    return m;
+  }();
+
+  return int(0666 & ~mask);
+#else
+  TP_UNUSED(fileName);
+  return 0666;
+#endif
+}
+
+//##################################################################################################
+std::string replacementFilePath(const std::string& fileName, bool& inPlace)
+{
+  inPlace = true;
+
+#ifdef TDP_LINUX
+  struct stat st;
+  if(::stat(fileName.c_str(), &st) != 0)
+  {
+    //Write through a dangling symlink, creating the file that it points to.
+    inPlace = (::lstat(fileName.c_str(), &st) == 0);
+    return fileName;
+  }
+
+  if(!S_ISREG(st.st_mode) || st.st_nlink>1)
+    return fileName;
+
+  inPlace = false;
+  std::string target = fileName;
+  if(char* resolved = ::realpath(fileName.c_str(), nullptr); resolved)
+  {
+    target = resolved;
+    ::free(resolved);
+  }
+  return target;
+#else
+  return fileName;
+#endif
+}
+
+//##################################################################################################
+AtomicFileWriter::AtomicFileWriter(const std::string& fileName, bool binary, SyncToDisk syncToDisk):
+  d(new Private(fileName, syncToDisk))
+{
+#ifdef TDP_LINUX
+  TP_UNUSED(binary);
+
+  d->fileName = replacementFilePath(fileName, d->inPlace);
+  if(d->inPlace)
+  {
+    d->fd = ::open(d->fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    d->ok = (d->fd>=0);
+    return;
+  }
+
+  std::string tmpName = d->fileName + ".tmp.XXXXXX";
+  d->fd = ::mkostemp(tmpName.data(), O_CLOEXEC);
+  if(d->fd<0)
+    return;
+
+  d->tmpName = tmpName;
+
+  //mkostemp creates the file 0600, match the permissions of the file we are replacing.
+  if(::fchmod(d->fd, mode_t(replacementFileMode(d->fileName))) != 0)
+  {
+    d->discard();
+    return;
+  }
+
+  d->ok = true;
+#else
+  try
+  {
+    d->out.open(fileName, binary?(std::ios::out | std::ios::binary):std::ios::out);
+    d->ok = d->out.is_open();
+  }
+  catch(...)
+  {
+    d->ok = false;
+  }
+#endif
+}
+
+//##################################################################################################
+AtomicFileWriter::~AtomicFileWriter()
+{
+#ifdef TDP_LINUX
+  d->discard();
+#endif
+  delete d;
+}
+
+//##################################################################################################
+bool AtomicFileWriter::isOK() const
+{
+  return d->ok;
+}
+
+//##################################################################################################
+bool AtomicFileWriter::write(const char* data, size_t size)
+{
+  if(!d->ok || d->finished)
+    return false;
+
+  if(!size)
+    return true;
+
+#ifdef TDP_LINUX
+  if(d->buffer.size()+size <= Private::bufferSize)
+  {
+    d->buffer.insert(d->buffer.end(), data, data+size);
+    return true;
+  }
+
+  //Large writes go straight to the file along with anything already buffered.
+  return d->flush(data, size);
+#else
+  try
+  {
+    d->out.write(data, std::streamsize(size));
+    d->ok = !d->out.fail();
+  }
+  catch(...)
+  {
+    d->ok = false;
+  }
+  return d->ok;
+#endif
+}
+
+//##################################################################################################
+bool AtomicFileWriter::commit()
+{
+  if(d->finished)
+    return false;
+  d->finished = true;
+
+#ifdef TDP_LINUX
+  if(!d->ok || !d->flush())
+  {
+    d->discard();
+    return false;
+  }
+
+  //Special files written in place such as FIFOs can not be synced, fdatasync reports EINVAL.
+  if(d->syncToDisk == SyncToDisk::Yes && ::fdatasync(d->fd) != 0 && !(d->inPlace && errno == EINVAL))
+  {
+    d->discard();
+    return false;
+  }
+
+  int fd = std::exchange(d->fd, -1);
+  if(::close(fd) != 0)
+  {
+    d->discard();
+    return false;
+  }
+
+  if(d->inPlace)
+    return true;
+
+  if(::rename(d->tmpName.c_str(), d->fileName.c_str()) != 0)
+  {
+    d->discard();
+    return false;
+  }
+  d->tmpName.clear();
+
+  if(d->syncToDisk == SyncToDisk::Yes)
+    return syncParentDirectory(d->fileName);
+
+  return true;
+#else
+  try
+  {
+    d->out.flush();
+    d->out.close();
+    return d->ok && !d->out.fail();
+  }
+  catch(...)
+  {
+    return false;
+  }
+#endif
+}
+
 //##################################################################################################
 std::string TP_UTILS_SHARED_EXPORT readTextFile(const std::string& fileName)
 {
@@ -38,18 +618,145 @@ std::string TP_UTILS_SHARED_EXPORT readBinaryFile(const std::string& fileName)
   }
   catch(...)
   {
-    return std::string();
+    return std::string();
+  }
+}
+
+//##################################################################################################
+bool TP_UTILS_SHARED_EXPORT writeTextFile(const std::string& fileName, const std::string& textOutput, SyncToDisk syncToDisk)
+{
+  AtomicFileWriter writer(fileName, false, syncToDisk);
+  writer.write(textOutput.data(), textOutput.size());
+  return writer.commit();
+}
+
+//##################################################################################################
+bool TP_UTILS_SHARED_EXPORT writeBinaryFile(const std::string& fileName, const std::string& textOutput, SyncToDisk syncToDisk)
+{
+  AtomicFileWriter writer(fileName, true, syncToDisk);
+  writer.write(textOutput.data(), textOutput.size());
+  return writer.commit();
+}
+
+//##################################################################################################
+nlohmann::json TP_UTILS_SHARED_EXPORT readJSONFile(const std::string& fileName)
+{
+  try
+  {
+    return parseFile(fileName, nlohmann::json(), [&](auto&&... input)
+    {
+      return nlohmann::json::parse(input...);
+    });
+  }
+  catch(...)
+  {
+    return nlohmann::json();
+  }
+}
+
+//##################################################################################################
+nlohmann::json TP_UTILS_SHARED_EXPORT readJSONFile(const std::string& fileName, const nlohmann::json::parser_callback_t& callback)
+{
+  try
+  {
+    return parseFile(fileName, nlohmann::json(), [&](auto&&... input)
+    {
+      return nlohmann::json::parse(input..., callback);
+    });
+  }
+  catch(...)
+  {
+    return nlohmann::json();
+  }
+}
+
+//##################################################################################################
+bool TP_UTILS_SHARED_EXPORT readJSONFileSAX(const std::string& fileName, nlohmann::json::json_sax_t& sax)
+{
+  try
+  {
+    return parseFile(fileName, false, [&](auto&&... input)
+    {
+      return nlohmann::json::sax_parse(input..., &sax);
+    });
+  }
+  catch(...)
+  {
+    return false;
+  }
+}
+
+//##################################################################################################
+nlohmann::json readBinaryJSONFile(const std::string& fileName, JSONFormat format)
+{
+  try
+  {
+#ifdef TDP_LINUX
+    return parseFile(fileName, nlohmann::json(), [&](const char* begin, const char* end)
+    {
+      auto data = reinterpret_cast<const uint8_t*>(begin);
+      auto size = size_t(end-begin);
+      auto f = (format==JSONFormat::Auto)?detectJSONFormat(data, size):format;
+
+      if(f==JSONFormat::CBOR && size>=3 && std::memcmp(data, cborMagic, 3)==0)
+        data+=3;
+
+      return parseJSON(f, data, reinterpret_cast<const uint8_t*>(end));
+    });
+#else
+    std::string data = readBinaryFile(fileName);
+    auto begin = reinterpret_cast<const uint8_t*>(data.data());
+    auto end = begin+data.size();
+    auto f = (format==JSONFormat::Auto)?detectJSONFormat(begin, data.size()):format;
+
+    if(f==JSONFormat::CBOR && data.size()>=3 && std::memcmp(begin, cborMagic, 3)==0)
+      begin+=3;
+
+    return parseJSON(f, begin, end);
+#endif
+  }
+  catch(...)
+  {
+    return nlohmann::json();
   }
 }
 
 //##################################################################################################
-bool TP_UTILS_SHARED_EXPORT writeTextFile(const std::string& fileName, const std::string& textOutput)
+bool writeBinaryJSONFile(const std::string& fileName, const nlohmann::json& j, JSONFormat format, SyncToDisk syncToDisk)
 {
   try
   {
-    std::ofstream out(fileName);
-    out << textOutput;
-    return true;
+    AtomicFileWriter writer(fileName, true, syncToDisk);
+    JSONSerializer serializer(writer);
+    std::ostream& stream = serializer.stream();
+
+    switch(format)
+    {
+    case JSONFormat::Auto: [[fallthrough]];
+    case JSONFormat::CBOR:
+      stream.write(reinterpret_cast<const char*>(cborMagic), 3);
+      nlohmann::json::to_cbor(j, stream);
+      break;
+
+    case JSONFormat::MessagePack:
+      if(!j.is_object() && !j.is_array())
+        return false;
+      nlohmann::json::to_msgpack(j, stream);
+      break;
+
+    case JSONFormat::UBJSON:
+      if(!j.is_object() && !j.is_array())
+        return false;
+      nlohmann::json::to_ubjson(j, stream, true, true);
+      break;
+
+    case JSONFormat::Text:
+      serializer.dump(j, -1);
+      break;
+    }
+
+    stream.flush();
+    return writer.commit();
   }
   catch(...)
   {
@@ -58,13 +765,14 @@ bool TP_UTILS_SHARED_EXPORT writeTextFile(const std::string& fileName, const std
 }
 
 //##################################################################################################
-bool TP_UTILS_SHARED_EXPORT writeBinaryFile(const std::string& fileName, const std::string& textOutput)
+bool writeJSONFile(const std::string& fileName, const nlohmann::json& j, int indent, SyncToDisk syncToDisk)
 {
   try
   {
-    std::ofstream out(fileName, std::ios::binary);
-    out << textOutput;
-    return true;
+    AtomicFileWriter writer(fileName, false, syncToDisk);
+    JSONSerializer serializer(writer);
+    serializer.dump(j, indent);
+    return writer.commit();
   }
   catch(...)
   {
@@ -73,45 +781,195 @@ bool TP_UTILS_SHARED_EXPORT writeBinaryFile(const std::string& fileName, const s
 }
 
 //##################################################################################################
-nlohmann::json TP_UTILS_SHARED_EXPORT readJSONFile(const std::string& fileName)
+bool writePrettyJSONFile(const std::string& fileName, const nlohmann::json& j, SyncToDisk syncToDisk)
 {
-  try
+  return writeJSONFile(fileName, j, 2, syncToDisk);
+}
+
+//##################################################################################################
+struct JSONStreamWriter::Private
+{
+  AtomicFileWriter writer;
+  JSONSerializer serializer{writer};
+  int indent;
+  bool ok;
+  bool written{false};
+
+  struct Container
+  {
+    bool object;
+    bool empty{true};
+    bool expectingValue{false};
+  };
+  std::vector<Container> stack;
+
+  //################################################################################################
+  Private(const std::string& fileName, int indent_, SyncToDisk syncToDisk):
+    writer(fileName, false, syncToDisk),
+    indent(indent_),
+    ok(writer.isOK())
   {
-    std::string str = readTextFile(fileName);
-    return nlohmann::json::parse(str);
+
   }
-  catch(...)
+
+  //################################################################################################
+  void newLine(size_t depth)
   {
-    return nlohmann::json();
+    if(indent<0)
+      return;
+
+    writer.write("\n", 1);
+    size_t n = depth*size_t(indent);
+    while(n)
+    {
+      static const std::string spaces(64, ' ');
+      size_t c = tpMin(n, spaces.size());
+      writer.write(spaces.data(), c);
+      n-=c;
+    }
+  }
+
+  //################################################################################################
+  //! Write the separator that comes before a key, or a value in an array.
+  bool beginElement(bool isKey)
+  {
+    if(!ok)
+      return false;
+
+    if(stack.empty())
+    {
+      //Only a single value may be written at the top level.
+      ok = !isKey && !written;
+      written = true;
+      return ok;
+    }
+
+    Container& c = stack.back();
+    if(c.object && !isKey)
+    {
+      //A value in an object must follow its key.
+      ok = c.expectingValue;
+      c.expectingValue = false;
+      return ok;
+    }
+
+    if(c.object != isKey || c.expectingValue)
+    {
+      ok = false;
+      return false;
+    }
+
+    if(!c.empty)
+      writer.write(",", 1);
+    c.empty = false;
+    newLine(stack.size());
+    return true;
+  }
+
+  //################################################################################################
+  void begin(bool object)
+  {
+    if(!beginElement(false))
+      return;
+
+    writer.write(object?"{":"[", 1);
+    stack.push_back({object});
+  }
+};
+
+//##################################################################################################
+JSONStreamWriter::JSONStreamWriter(const std::string& fileName, int indent, SyncToDisk syncToDisk):
+  d(new Private(fileName, indent, syncToDisk))
+{
+
+}
+
+//##################################################################################################
+JSONStreamWriter::~JSONStreamWriter()
+{
+  delete d;
+}
+
+//##################################################################################################
+bool JSONStreamWriter::isOK() const
+{
+  return d->ok;
+}
+
+//##################################################################################################
+void JSONStreamWriter::beginObject()
+{
+  d->begin(true);
+}
+
+//##################################################################################################
+void JSONStreamWriter::beginArray()
+{
+  d->begin(false);
+}
+
+//##################################################################################################
+void JSONStreamWriter::end()
+{
+  if(!d->ok)
+    return;
+
+  if(d->stack.empty() || d->stack.back().expectingValue)
+  {
+    d->ok = false;
+    return;
   }
+
+  Private::Container c = tpTakeLast(d->stack);
+  if(!c.empty)
+    d->newLine(d->stack.size());
+  d->writer.write(c.object?"}":"]", 1);
 }
 
 //##################################################################################################
-bool writeJSONFile(const std::string& fileName, const nlohmann::json& j, int indent)
+void JSONStreamWriter::key(const std::string& key)
 {
+  if(!d->beginElement(true))
+    return;
+
   try
   {
-    std::string s = j.dump(indent);
-    return writeTextFile(fileName, s);
+    d->serializer.dump(nlohmann::json(key), -1);
+    d->writer.write(": ", (d->indent<0)?1:2);
+    d->stack.back().expectingValue = true;
   }
   catch(...)
   {
-    return false;
+    d->ok = false;
   }
 }
 
 //##################################################################################################
-bool writePrettyJSONFile(const std::string& fileName, const nlohmann::json& j)
+void JSONStreamWriter::value(const nlohmann::json& j)
 {
+  if(!d->beginElement(false))
+    return;
+
   try
   {
-    std::string s = j.dump(2);
-    return writeTextFile(fileName, s);
+    d->serializer.dump(j, d->indent, d->stack.size());
   }
   catch(...)
   {
+    d->ok = false;
+  }
+}
+
+//##################################################################################################
+bool JSONStreamWriter::commit()
+{
+  if(!d->ok || !d->written || !d->stack.empty())
+  {
+    d->ok = false;
     return false;
   }
+
+  return d->writer.commit();
 }
 
 //##################################################################################################
@@ -123,46 +981,587 @@ bool (*mkdirCallback)(const std::string& path, CreateFullPath createFullPath)=nu
 bool (*rmCallback)(const std::string& path, bool recursive)=nullptr;
 bool (*existsCallback)(const std::string& path)=nullptr;
 
+#ifdef TDP_LINUX
+namespace
+{
+//##################################################################################################
+//! Calls callback(name, type) for each entry in a directory except "." and "..".
+/*!
+This calls getdents64 directly with a large buffer, type is the d_type reported by the file system
+and may be DT_UNKNOWN, see resolveType().
+*/
+template<typename T>
+bool forEachDirectoryEntry(int fd, const T& callback)
+{
+  std::vector<char> buffer(64*1024);
+  for(;;)
+  {
+    long n = ::syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+    if(n<0)
+    {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+
+    if(n==0)
+      return true;
+
+    for(long pos=0; pos<n;)
+    {
+      const auto e = reinterpret_cast<const struct dirent64*>(buffer.data()+pos);
+      pos += e->d_reclen;
+
+      const char* name = e->d_name;
+      if(name[0]=='.' && (name[1]=='\0' || (name[1]=='.' && name[2]=='\0')))
+        continue;
+
+      callback(name, e->d_type);
+    }
+  }
+}
+
+//##################################################################################################
+//! Resolve DT_UNKNOWN and follow symlinks to find out what an entry really is.
+unsigned char resolveType(int dirFD, const char* name, unsigned char type)
+{
+  if(type != DT_UNKNOWN && type != DT_LNK)
+    return type;
+
+  struct stat st;
+  if(::fstatat(dirFD, name, &st, 0) != 0)
+    return DT_UNKNOWN;
+
+  if(S_ISDIR(st.st_mode))
+    return DT_DIR;
+
+  if(S_ISREG(st.st_mode))
+    return DT_REG;
+
+  return DT_UNKNOWN;
+}
+
+//##################################################################################################
+//! Returns the absolute path of a directory with a trailing slash.
+std::string absoluteDirectory(const std::string& path)
+{
+  std::string result;
+  if(char* p = ::realpath(path.c_str(), nullptr); p)
+  {
+    result = p;
+    ::free(p);
+  }
+  else
+    result = path;
+
+  if(result.empty() || result.back() != '/')
+    result.push_back('/');
+
+  return result;
+}
+
+//##################################################################################################
+//! Matches file names against patterns in the format "*.png".
+/*!
+Patterns in the format "*.ext" are stored in a hash set, names are then matched by looking up the part
+of the name following each '.', this also handles multi part extensions like "*.tar.gz". Anything
+else is matched with fnmatch.
+*/
+class NameFilter
+{
+  std::vector<std::string> m_extensionStorage;
+  std::unordered_set<std::string_view> m_extensions;
+  std::vector<std::string> m_suffixes;
+  std::vector<std::string> m_patterns;
+  bool m_all;
+
+public:
+  //################################################################################################
+  NameFilter(const std::unordered_set<std::string>& extensions):
+    m_all(extensions.empty())
+  {
+    m_extensionStorage.reserve(extensions.size());
+    for(const auto& extension : extensions)
+    {
+      if(extension == "*")
+        m_all = true;
+      else if(extension.size()>1 && extension.front()=='*' && extension.find_first_of("*?[", 1) == std::string::npos)
+      {
+        if(extension.at(1) == '.')
+          m_extensions.insert(m_extensionStorage.emplace_back(extension.substr(1)));
+        else
+          m_suffixes.push_back(extension.substr(1));
+      }
+      else
+        m_patterns.push_back(extension);
+    }
+  }
+
+  //################################################################################################
+  bool matches(const char* name) const
+  {
+    if(m_all)
+      return true;
+
+    std::string_view n(name);
+
+    if(!m_extensions.empty())
+      for(auto i = n.rfind('.'); i != std::string_view::npos; i = (i==0)?std::string_view::npos:n.rfind('.', i-1))
+        if(m_extensions.count(n.substr(i)))
+          return true;
+
+    for(const auto& suffix : m_suffixes)
+      if(n.size()>=suffix.size() && n.compare(n.size()-suffix.size(), suffix.size(), suffix)==0)
+        return true;
+
+    for(const auto& pattern : m_patterns)
+      if(::fnmatch(pattern.c_str(), name, 0) == 0)
+        return true;
+
+    return false;
+  }
+};
+
+//##################################################################################################
+//! Lists the entries in a directory that resolve to the given type.
+template<typename T>
+std::vector<std::string> listEntries(const std::string& path, unsigned char wantedType, const T& filter)
+{
+  std::vector<std::string> results;
+
+  int fd = ::openat(AT_FDCWD, path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(fd<0)
+    return results;
+  TP_CLEANUP([&]{::close(fd);});
+
+  std::string directory = absoluteDirectory(path);
+  forEachDirectoryEntry(fd, [&](const char* name, unsigned char type)
+  {
+    if(resolveType(fd, name, type) == wantedType && filter(name))
+      results.push_back(directory + name);
+  });
+
+  return results;
+}
+
+//##################################################################################################
+//! Copy from one fd to another using the fastest method supported by the file systems.
+/*!
+copy_file_range keeps the data in the kernel and lets file systems that support it share extents,
+if the file systems don't support it we fall back to sendfile and then to read/write.
+*/
+bool copyFileContents(int in, int out)
+{
+  constexpr size_t chunk = size_t(1)<<30;
+  bool useCopyFileRange = true;
+  bool useSendfile = true;
+  std::vector<char> buffer;
+
+  for(;;)
+  {
+    ssize_t n;
+    if(useCopyFileRange)
+    {
+      n = ::copy_file_range(in, nullptr, out, nullptr, chunk, 0);
+      if(n<0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+      {
+        useCopyFileRange = false;
+        continue;
+      }
+    }
+    else if(useSendfile)
+    {
+      n = ::sendfile(out, in, nullptr, chunk);
+      if(n<0 && (errno == ENOSYS || errno == EINVAL))
+      {
+        useSendfile = false;
+        continue;
+      }
+    }
+    else
+    {
+      buffer.resize(128*1024);
+      n = ::read(in, buffer.data(), buffer.size());
+      if(n>0)
+      {
+        struct iovec iov;
+        iov.iov_base = buffer.data();
+        iov.iov_len  = size_t(n);
+        if(!writeAll(out, &iov, 1))
+          return false;
+      }
+    }
+
+    if(n<0)
+    {
+      if(errno == EINTR)
+        continue;
+      return false;
+    }
+
+    if(n==0)
+      return true;
+  }
+}
+
+//##################################################################################################
+//! Removes a file or directory tree relative to dirFD without following symlinks.
+bool removeRecursive(int dirFD, const char* name)
+{
+  if(::unlinkat(dirFD, name, 0) == 0)
+    return true;
+
+  if(errno != EISDIR)
+    return false;
+
+  int fd = ::openat(dirFD, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+  if(fd<0)
+    return false;
+
+  //Collect the names first, the contents of a directory are unspecified while it is modified.
+  std::vector<std::string> names;
+  bool ok = forEachDirectoryEntry(fd, [&](const char* entry, unsigned char)
+  {
+    names.emplace_back(entry);
+  });
+
+  for(const auto& entry : names)
+    ok = removeRecursive(fd, entry.c_str()) && ok;
+
+  ::close(fd);
+
+  return ok && ::unlinkat(dirFD, name, AT_REMOVEDIR) == 0;
+}
+
+//##################################################################################################
+//! Create a single directory, returns true if it was created or is already a directory.
+bool makeDirectory(const std::string& path)
+{
+  if(::mkdir(path.c_str(), 0777) == 0)
+    return true;
+
+  if(errno != EEXIST)
+    return false;
+
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+}
+#endif
+
 //##################################################################################################
 std::vector<std::string> listFiles(const std::string& path, const std::unordered_set<std::string>& extensions)
 {
-  return listFilesCallback?listFilesCallback(path, extensions):std::vector<std::string>();
+  if(listFilesCallback)
+    return listFilesCallback(path, extensions);
+
+#ifdef TDP_LINUX
+  NameFilter nameFilter(extensions);
+  return listEntries(path, DT_REG, [&](const char* name){return nameFilter.matches(name);});
+#else
+  return std::vector<std::string>();
+#endif
+}
+
+#ifdef TDP_LINUX
+namespace
+{
+//##################################################################################################
+//! Shared state for the threads used by scanFiles.
+struct ScanFilesState
+{
+  const NameFilter& nameFilter;
+  const std::function<void(const FileInfo&)>& callback;
+  bool collectMetadata;
+
+  TPMutex mutex{TPM};
+  TPWaitCondition waitCondition;
+  std::vector<std::string> directories;
+  size_t active{0};
+
+  TPMutex callbackMutex{TPM};
+
+  //################################################################################################
+  ScanFilesState(const NameFilter& nameFilter_,
+                 const std::function<void(const FileInfo&)>& callback_,
+                 bool collectMetadata_):
+    nameFilter(nameFilter_),
+    callback(callback_),
+    collectMetadata(collectMetadata_)
+  {
+
+  }
+
+  //################################################################################################
+  //! Read a single directory, returns the files that match and the sub directories to scan.
+  void scanDirectory(const std::string& directory, std::vector<FileInfo>& files, std::vector<std::string>& subDirectories)
+  {
+    int fd = ::openat(AT_FDCWD, directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd<0)
+      return;
+    TP_CLEANUP([&]{::close(fd);});
+
+    forEachDirectoryEntry(fd, [&](const char* name, unsigned char type)
+    {
+      if(type == DT_UNKNOWN)
+      {
+        struct stat st;
+        if(::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+          return;
+        type = S_ISDIR(st.st_mode)?DT_DIR:(S_ISLNK(st.st_mode)?DT_LNK:(S_ISREG(st.st_mode)?DT_REG:DT_UNKNOWN));
+      }
+
+      if(type == DT_DIR)
+      {
+        subDirectories.push_back(directory + name + '/');
+        return;
+      }
+
+      //Symlinks are included if they point at a file, but not followed if they point at a directory.
+      if(type == DT_LNK && resolveType(fd, name, type) != DT_REG)
+        return;
+
+      if(type != DT_REG && type != DT_LNK)
+        return;
+
+      if(!nameFilter.matches(name))
+        return;
+
+      FileInfo& info = files.emplace_back();
+      info.path = directory + name;
+
+      if(collectMetadata)
+      {
+        struct statx stx;
+        if(::statx(fd, name, AT_STATX_DONT_SYNC, STATX_SIZE | STATX_MTIME, &stx) == 0)
+        {
+          info.size = int64_t(stx.stx_size);
+          info.timeMS = int64_t(stx.stx_mtime.tv_sec)*1000 + int64_t(stx.stx_mtime.tv_nsec)/1000000;
+        }
+      }
+    });
+  }
+
+  //################################################################################################
+  void run()
+  {
+    std::vector<FileInfo> files;
+    std::vector<std::string> subDirectories;
+
+    mutex.lock(TPM);
+    for(;;)
+    {
+      while(directories.empty() && active>0)
+        waitCondition.wait(TPMc mutex);
+
+      if(directories.empty())
+        break;
+
+      std::string directory = tpTakeLast(directories);
+      active++;
+      mutex.unlock(TPM);
+
+      scanDirectory(directory, files, subDirectories);
+
+      if(!files.empty())
+      {
+        TP_MUTEX_LOCKER(callbackMutex);
+        for(const auto& file : files)
+          callback(file);
+      }
+      files.clear();
+
+      mutex.lock(TPM);
+      active--;
+      for(auto& subDirectory : subDirectories)
+        directories.push_back(std::move(subDirectory));
+      subDirectories.clear();
+
+      //Wake everyone when there is more work or when all of the work is done.
+      if(!directories.empty() || active==0)
+        waitCondition.wakeAll();
+    }
+    mutex.unlock(TPM);
+  }
+};
+}
+#endif
+
+//##################################################################################################
+void scanFiles(const std::string& path,
+               const std::unordered_set<std::string>& extensions,
+               const std::function<void(const FileInfo&)>& callback,
+               bool collectMetadata,
+               size_t threads)
+{
+#ifdef TDP_LINUX
+  if(!listFilesCallback && !listDirectoriesCallback)
+  {
+    if(threads == 0)
+      threads = tpMax(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+    NameFilter nameFilter(extensions);
+    ScanFilesState state(nameFilter, callback, collectMetadata);
+    state.directories.push_back(absoluteDirectory(path));
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads-1);
+    for(size_t i=1; i<threads; i++)
+      workers.emplace_back([&]{state.run();});
+
+    state.run();
+
+    for(auto& worker : workers)
+      worker.join();
+    return;
+  }
+#endif
+
+  TP_UNUSED(threads);
+  std::vector<std::string> directories{path};
+  while(!directories.empty())
+  {
+    std::string directory = tpTakeLast(directories);
+
+    for(const auto& file : listFiles(directory, extensions))
+    {
+      FileInfo info;
+      info.path = file;
+      if(collectMetadata)
+        info.timeMS = fileTimeMS(file);
+      callback(info);
+    }
+
+    for(auto& subDirectory : listDirectories(directory))
+      directories.push_back(std::move(subDirectory));
+  }
 }
 
 //##################################################################################################
 std::vector<std::string> listDirectories(const std::string& path)
 {
-  return listDirectoriesCallback?listDirectoriesCallback(path):std::vector<std::string>();
+  if(listDirectoriesCallback)
+    return listDirectoriesCallback(path);
+
+#ifdef TDP_LINUX
+  return listEntries(path, DT_DIR, [](const char*){return true;});
+#else
+  return std::vector<std::string>();
+#endif
 }
 
 //##################################################################################################
 int64_t fileTimeMS(const std::string& path)
 {
-  return fileTimeMSCallback?fileTimeMSCallback(path):0;
+  if(fileTimeMSCallback)
+    return fileTimeMSCallback(path);
+
+#ifdef TDP_LINUX
+  struct statx stx;
+  if(::statx(AT_FDCWD, path.c_str(), 0, STATX_MTIME, &stx) != 0 || !(stx.stx_mask & STATX_MTIME))
+    return 0;
+
+  return int64_t(stx.stx_mtime.tv_sec)*1000 + int64_t(stx.stx_mtime.tv_nsec)/1000000;
+#else
+  return 0;
+#endif
 }
 
 //##################################################################################################
 bool copyFile(const std::string& pathFrom, const std::string& pathTo)
 {
-  return copyFileCallback?copyFileCallback(pathFrom, pathTo):false;
+  if(copyFileCallback)
+    return copyFileCallback(pathFrom, pathTo);
+
+#ifdef TDP_LINUX
+  int in = ::open(pathFrom.c_str(), O_RDONLY | O_CLOEXEC);
+  if(in<0)
+    return false;
+  TP_CLEANUP([&]{::close(in);});
+
+  struct stat st;
+  if(::fstat(in, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+
+  //Copying a file over itself, or over another link to it, would leave nothing to copy.
+  struct stat stTo;
+  if(::stat(pathTo.c_str(), &stTo) == 0 && stTo.st_dev == st.st_dev && stTo.st_ino == st.st_ino)
+    return true;
+
+  //Replace the target of a symlink rather than the link itself, as opening it would have.
+  std::string target = pathTo;
+  if(char* resolved = ::realpath(pathTo.c_str(), nullptr); resolved)
+  {
+    target = resolved;
+    ::free(resolved);
+  }
+
+  //Copy into a temporary file and rename it over the target so it is never left truncated.
+  std::string tmpName = target + ".tmp.XXXXXX";
+  int out = ::mkostemp(tmpName.data(), O_CLOEXEC);
+  if(out<0)
+    return false;
+
+  bool ok = (::fchmod(out, st.st_mode & 07777) == 0) && copyFileContents(in, out);
+  ok = (::close(out) == 0) && ok;
+  ok = ok && (::rename(tmpName.c_str(), target.c_str()) == 0);
+
+  if(!ok)
+    ::unlink(tmpName.c_str());
+
+  return ok;
+#else
+  return false;
+#endif
 }
 
 //##################################################################################################
 bool mkdir(const std::string& path, CreateFullPath createFullPath)
 {
-  return mkdirCallback?mkdirCallback(path, createFullPath):false;
+  if(mkdirCallback)
+    return mkdirCallback(path, createFullPath);
+
+#ifdef TDP_LINUX
+  if(createFullPath == CreateFullPath::No)
+    return ::mkdir(path.c_str(), 0777) == 0;
+
+  for(size_t i=1; i<path.size(); i++)
+    if(path.at(i) == '/' && path.at(i-1) != '/')
+      makeDirectory(path.substr(0, i));
+
+  return makeDirectory(path);
+#else
+  return false;
+#endif
 }
 
 //##################################################################################################
 bool rm(const std::string& path, bool recursive)
 {
-  return rmCallback?rmCallback(path, recursive):false;
+  if(rmCallback)
+    return rmCallback(path, recursive);
+
+#ifdef TDP_LINUX
+  if(recursive)
+    return removeRecursive(AT_FDCWD, path.c_str());
+
+  return ::unlink(path.c_str()) == 0 || (errno == EISDIR && ::rmdir(path.c_str()) == 0);
+#else
+  return false;
+#endif
 }
 
 //##################################################################################################
 bool exists(const std::string& path)
 {
-  return existsCallback?existsCallback(path):false;
+  if(existsCallback)
+    return existsCallback(path);
+
+#ifdef TDP_LINUX
+  return ::access(path.c_str(), F_OK) == 0;
+#else
+  return false;
+#endif
 }
 
 }
@@ -0,0 +1,563 @@
+#include "tp_utils/FileWatcher.h"
+#include "tp_utils/AbstractCrossThreadCallback.h"
+#include "tp_utils/FileUtils.h"
+#include "tp_utils/MutexUtils.h"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+
+#ifdef TDP_LINUX
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#endif
+
+namespace tp_utils
+{
+
+namespace
+{
+#ifdef TDP_LINUX
+//##################################################################################################
+constexpr uint32_t watchMask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+//##################################################################################################
+//! How often to try to watch paths again after their parent directory has been removed.
+constexpr int64_t rearmIntervalMS = 500;
+
+//##################################################################################################
+//! The paths that are interested in events from a single inotify watch descriptor.
+struct Watch
+{
+  //! File name in the directory -> path passed to addPath.
+  std::unordered_map<std::string, std::string> names;
+
+  //! The path passed to addPath if this is a watch on that directory itself.
+  std::string selfPath;
+};
+
+//##################################################################################################
+//! The watch descriptors used by a path.
+struct WatchedPath
+{
+  int parentWD{-1};
+  int selfWD{-1};
+};
+
+//##################################################################################################
+//! Split a path into its parent directory and name.
+void splitPath(const std::string& path, std::string& directory, std::string& name)
+{
+  std::string p = path;
+  while(p.size()>1 && p.back() == '/')
+    p.pop_back();
+
+  auto i = p.find_last_of('/');
+  if(i == std::string::npos)
+  {
+    directory = ".";
+    name = p;
+  }
+  else
+  {
+    directory = (i==0)?std::string("/"):p.substr(0, i);
+    name = p.substr(i+1);
+  }
+}
+#endif
+
+//##################################################################################################
+int64_t steadyTimeMS()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+}
+
+//##################################################################################################
+struct FileWatcher::Private
+{
+  TP_NONCOPYABLE(Private);
+
+  FileWatcher* q;
+  int64_t debounceMS;
+  std::unique_ptr<AbstractCrossThreadCallback> crossThreadCallback;
+
+  mutable TPMutex mutex{TPM};
+  bool finish{false};
+
+  //! Path -> time of the most recent event.
+  std::unordered_map<std::string, int64_t> pendingChanges;
+
+  //! Paths that have settled and are waiting to be delivered by the cross thread callback.
+  std::vector<std::string> readyChanges;
+
+  std::thread thread;
+
+#ifdef TDP_LINUX
+  int inotifyFD{-1};
+  int eventFD{-1};
+  std::unordered_map<int, Watch> watches;
+  std::unordered_map<std::string, WatchedPath> watchedPaths;
+
+  //! True if some paths have lost the watch on their parent directory.
+  bool orphaned{false};
+#else
+  TPWaitCondition waitCondition;
+
+  //! Path -> last modification time.
+  std::unordered_map<std::string, int64_t> watchedPaths;
+#endif
+
+  //################################################################################################
+  Private(FileWatcher* q_, int64_t debounceMS_):
+    q(q_),
+    debounceMS(tpMax(debounceMS_, int64_t(0)))
+  {
+
+  }
+
+  //################################################################################################
+  //! Record an event for a path, the mutex must be locked.
+  void markChanged(const std::string& path, int64_t now)
+  {
+    pendingChanges[path] = now;
+  }
+
+  //################################################################################################
+  //! Take the paths that have been quiet for debounceMS, returns the time to wait for the next one.
+  int64_t takeSettled(int64_t now, std::vector<std::string>& settled)
+  {
+    int64_t wait = -1;
+
+    TP_MUTEX_LOCKER(mutex);
+    for(auto i = pendingChanges.begin(); i != pendingChanges.end();)
+    {
+      int64_t remaining = (i->second + debounceMS) - now;
+      if(remaining<=0)
+      {
+        settled.push_back(i->first);
+        i = pendingChanges.erase(i);
+      }
+      else
+      {
+        wait = (wait<0)?remaining:tpMin(wait, remaining);
+        ++i;
+      }
+    }
+
+    return wait;
+  }
+
+  //################################################################################################
+  void deliver(std::vector<std::string>& settled)
+  {
+    if(settled.empty())
+      return;
+
+    if(crossThreadCallback)
+    {
+      {
+        TP_MUTEX_LOCKER(mutex);
+        for(auto& path : settled)
+          readyChanges.push_back(std::move(path));
+      }
+      settled.clear();
+      crossThreadCallback->call();
+      return;
+    }
+
+    for(const auto& path : settled)
+      q->changed(path);
+    settled.clear();
+  }
+
+  //################################################################################################
+  //! Called on the cross thread callback's thread.
+  void deliverReady()
+  {
+    std::vector<std::string> ready;
+    {
+      TP_MUTEX_LOCKER(mutex);
+      ready.swap(readyChanges);
+    }
+
+    for(const auto& path : ready)
+      q->changed(path);
+  }
+
+#ifdef TDP_LINUX
+  //################################################################################################
+  //! Add a watch on a directory, the mutex must be locked.
+  int addWatch(const std::string& directory)
+  {
+    return inotify_add_watch(inotifyFD, directory.c_str(), watchMask | IN_ONLYDIR);
+  }
+
+  //################################################################################################
+  //! Add any watches that a path is missing, the mutex must be locked.
+  /*!
+  \return False if the parent directory still can't be watched.
+  */
+  bool rearm(const std::string& path, WatchedPath& watchedPath, int64_t now)
+  {
+    if(watchedPath.parentWD<0)
+    {
+      std::string directory;
+      std::string name;
+      splitPath(path, directory, name);
+
+      watchedPath.parentWD = addWatch(directory);
+      if(watchedPath.parentWD<0)
+        return false;
+      watches[watchedPath.parentWD].names[name] = path;
+
+      //The path may have been recreated while it was not watched.
+      markChanged(path, now);
+    }
+
+    struct stat st;
+    if(watchedPath.selfWD<0 && ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    {
+      watchedPath.selfWD = addWatch(path);
+      if(watchedPath.selfWD>=0)
+        watches[watchedPath.selfWD].selfPath = path;
+    }
+
+    return true;
+  }
+
+  //################################################################################################
+  //! Try to watch paths whose parent directory was removed, the mutex must be locked.
+  void rearmOrphans(int64_t now)
+  {
+    if(!orphaned)
+      return;
+
+    orphaned = false;
+    for(auto& i : watchedPaths)
+      if(i.second.parentWD<0 && !rearm(i.first, i.second, now))
+        orphaned = true;
+  }
+
+  //################################################################################################
+  //! Remove a watch if it is no longer used, the mutex must be locked.
+  void releaseWatch(int wd)
+  {
+    if(wd<0)
+      return;
+
+    auto i = watches.find(wd);
+    if(i == watches.end())
+      return;
+
+    if(i->second.names.empty() && i->second.selfPath.empty())
+    {
+      inotify_rm_watch(inotifyFD, wd);
+      watches.erase(i);
+    }
+  }
+
+  //################################################################################################
+  //! Handle a single inotify event, the mutex must be locked.
+  void handleEvent(const struct inotify_event* event, int64_t now)
+  {
+    if(event->mask & IN_Q_OVERFLOW)
+    {
+      //Events have been lost so everything may have changed.
+      for(const auto& i : watchedPaths)
+        markChanged(i.first, now);
+      return;
+    }
+
+    auto i = watches.find(event->wd);
+    if(i == watches.end())
+      return;
+
+    Watch& watch = i->second;
+
+    if(event->len>0)
+    {
+      auto n = watch.names.find(event->name);
+      if(n != watch.names.end())
+      {
+        markChanged(n->second, now);
+
+        //A watched directory that is recreated needs a new watch on itself.
+        if(event->mask & (IN_CREATE | IN_MOVED_TO))
+          if(auto w = watchedPaths.find(n->second); w != watchedPaths.end() && w->second.selfWD<0)
+            rearm(w->first, w->second, now);
+      }
+    }
+
+    if(!watch.selfPath.empty())
+      markChanged(watch.selfPath, now);
+
+    if(event->mask & IN_IGNORED)
+    {
+      //The directory has been deleted or unmounted so the kernel has dropped the watch. The paths
+      //are reported as changed and run() keeps trying to watch them again until the directory is
+      //recreated.
+      std::vector<std::string> names;
+      for(const auto& n : watch.names)
+      {
+        markChanged(n.second, now);
+        names.push_back(n.second);
+      }
+
+      std::string selfPath = watch.selfPath;
+      watches.erase(i);
+
+      if(!selfPath.empty())
+        if(auto w = watchedPaths.find(selfPath); w != watchedPaths.end())
+          w->second.selfWD = -1;
+
+      for(const auto& path : names)
+      {
+        if(auto w = watchedPaths.find(path); w != watchedPaths.end())
+        {
+          w->second.parentWD = -1;
+          if(!rearm(w->first, w->second, now))
+            orphaned = true;
+        }
+      }
+    }
+  }
+
+  //################################################################################################
+  void run()
+  {
+    alignas(struct inotify_event) char buffer[64*1024];
+    std::vector<std::string> settled;
+
+    for(;;)
+    {
+      bool retry=false;
+      {
+        TP_MUTEX_LOCKER(mutex);
+        rearmOrphans(steadyTimeMS());
+        retry = orphaned;
+      }
+
+      int64_t wait = takeSettled(steadyTimeMS(), settled);
+      deliver(settled);
+
+      if(retry)
+        wait = (wait<0)?rearmIntervalMS:tpMin(wait, rearmIntervalMS);
+
+      struct pollfd fds[2];
+      fds[0].fd = inotifyFD;
+      fds[0].events = POLLIN;
+      fds[1].fd = eventFD;
+      fds[1].events = POLLIN;
+
+      int n = ::poll(fds, 2, (wait<0)?-1:int(tpMin(wait, int64_t(INT32_MAX))));
+      if(n<0 && errno != EINTR)
+        break;
+
+      if(fds[1].revents & POLLIN)
+      {
+        TP_MUTEX_LOCKER(mutex);
+        if(finish)
+          break;
+      }
+
+      if(!(fds[0].revents & POLLIN))
+        continue;
+
+      ssize_t len = ::read(inotifyFD, buffer, sizeof(buffer));
+      if(len<=0)
+        continue;
+
+      int64_t now = steadyTimeMS();
+      TP_MUTEX_LOCKER(mutex);
+      for(ssize_t pos=0; pos<len;)
+      {
+        auto event = reinterpret_cast<const struct inotify_event*>(buffer+pos);
+        handleEvent(event, now);
+        pos += ssize_t(sizeof(struct inotify_event) + event->len);
+      }
+    }
+  }
+#else
+  //################################################################################################
+  void run()
+  {
+    std::vector<std::string> settled;
+    std::vector<std::string> paths;
+
+    mutex.lock(TPM);
+    while(!finish)
+    {
+      paths.clear();
+      for(const auto& i : watchedPaths)
+        paths.push_back(i.first);
+      mutex.unlock(TPM);
+
+      int64_t now = steadyTimeMS();
+      for(const auto& path : paths)
+      {
+        int64_t timeMS = fileTimeMS(path);
+
+        TP_MUTEX_LOCKER(mutex);
+        auto i = watchedPaths.find(path);
+        if(i != watchedPaths.end() && i->second != timeMS)
+        {
+          i->second = timeMS;
+          markChanged(path, now);
+        }
+      }
+
+      int64_t wait = takeSettled(steadyTimeMS(), settled);
+      deliver(settled);
+
+      mutex.lock(TPM);
+      if(!finish)
+        waitCondition.wait(TPMc mutex, (wait<0)?tpMax(debounceMS, int64_t(1)):tpMin(wait, tpMax(debounceMS, int64_t(1))));
+    }
+    mutex.unlock(TPM);
+  }
+#endif
+};
+
+//##################################################################################################
+FileWatcher::FileWatcher(int64_t debounceMS, AbstractCrossThreadCallbackFactory* crossThreadCallbackFactory):
+  d(new Private(this, debounceMS))
+{
+  if(crossThreadCallbackFactory)
+    d->crossThreadCallback.reset(crossThreadCallbackFactory->produce([&]{d->deliverReady();}));
+
+#ifdef TDP_LINUX
+  d->inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  d->eventFD = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(d->inotifyFD<0 || d->eventFD<0)
+    return;
+#endif
+
+  d->thread = std::thread([&]{d->run();});
+}
+
+//##################################################################################################
+FileWatcher::~FileWatcher()
+{
+  {
+    TP_MUTEX_LOCKER(d->mutex);
+    d->finish = true;
+  }
+
+#ifdef TDP_LINUX
+  if(d->eventFD>=0)
+  {
+    uint64_t one=1;
+    ssize_t n = ::write(d->eventFD, &one, sizeof(one));
+    TP_UNUSED(n);
+  }
+#else
+  d->waitCondition.wakeAll();
+#endif
+
+  if(d->thread.joinable())
+    d->thread.join();
+
+#ifdef TDP_LINUX
+  if(d->inotifyFD>=0)
+    ::close(d->inotifyFD);
+
+  if(d->eventFD>=0)
+    ::close(d->eventFD);
+#endif
+
+  delete d;
+}
+
+//##################################################################################################
+bool FileWatcher::addPath(const std::string& path)
+{
+  TP_MUTEX_LOCKER(d->mutex);
+
+#ifdef TDP_LINUX
+  if(d->inotifyFD<0)
+    return false;
+
+  if(tpContainsKey(d->watchedPaths, path))
+    return true;
+
+  std::string directory;
+  std::string name;
+  splitPath(path, directory, name);
+
+  WatchedPath watchedPath;
+  watchedPath.parentWD = d->addWatch(directory);
+  if(watchedPath.parentWD<0)
+    return false;
+  d->watches[watchedPath.parentWD].names[name] = path;
+
+  struct stat st;
+  if(::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+  {
+    watchedPath.selfWD = d->addWatch(path);
+    if(watchedPath.selfWD>=0)
+      d->watches[watchedPath.selfWD].selfPath = path;
+  }
+
+  d->watchedPaths[path] = watchedPath;
+  return true;
+#else
+  if(!tpContainsKey(d->watchedPaths, path))
+    d->watchedPaths[path] = fileTimeMS(path);
+  return true;
+#endif
+}
+
+//##################################################################################################
+void FileWatcher::removePath(const std::string& path)
+{
+  TP_MUTEX_LOCKER(d->mutex);
+
+  d->pendingChanges.erase(path);
+
+#ifdef TDP_LINUX
+  auto i = d->watchedPaths.find(path);
+  if(i == d->watchedPaths.end())
+    return;
+
+  WatchedPath watchedPath = i->second;
+  d->watchedPaths.erase(i);
+
+  if(auto w = d->watches.find(watchedPath.parentWD); w != d->watches.end())
+  {
+    std::string directory;
+    std::string name;
+    splitPath(path, directory, name);
+    w->second.names.erase(name);
+    d->releaseWatch(watchedPath.parentWD);
+  }
+
+  if(auto w = d->watches.find(watchedPath.selfWD); w != d->watches.end())
+  {
+    w->second.selfPath.clear();
+    d->releaseWatch(watchedPath.selfWD);
+  }
+#else
+  d->watchedPaths.erase(path);
+#endif
+}
+
+//##################################################################################################
+std::vector<std::string> FileWatcher::paths() const
+{
+  TP_MUTEX_LOCKER(d->mutex);
+
+  std::vector<std::string> paths;
+  paths.reserve(d->watchedPaths.size());
+  for(const auto& i : d->watchedPaths)
+    paths.push_back(i.first);
+  return paths;
+}
+
+}
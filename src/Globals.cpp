@@ -1,59 +1,219 @@
 #include "tp_utils/Globals.h"
 
-#include <codecvt>
-#include <locale>
 #include <algorithm>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+//##################################################################################################
+//! Maps each character to its hex value, or 0xFF if it is not a hex digit.
+struct HexDecodeTable
+{
+  uint8_t values[256];
+
+  constexpr HexDecodeTable():
+    values{}
+  {
+    for(int c=0; c<256; c++)
+      values[c] = 0xFF;
+
+    for(int c=0; c<10; c++)
+      values['0'+c] = uint8_t(c);
+
+    for(int c=0; c<6; c++)
+    {
+      values['A'+c] = uint8_t(10+c);
+      values['a'+c] = uint8_t(10+c);
+    }
+  }
+};
+
+constexpr HexDecodeTable hexDecodeTable;
+
+#ifdef __SSE2__
+//##################################################################################################
+//! Convert 16 nibbles (0-15) into their upper case hex characters.
+inline __m128i nibblesToHex(__m128i n)
+{
+  __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8('A'-'0'-10));
+  return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), letters);
+}
+
+//##################################################################################################
+//! Convert 16 hex characters into their values, sets valid to false if any are not hex digits.
+inline __m128i hexToNibbles(__m128i c, bool& valid)
+{
+  // Unsigned range checks done with signed compares by biasing the values by -128.
+  __m128i digit  = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  __m128i bias   = _mm_set1_epi8(char(0x80));
+
+  __m128i isDigit  = _mm_cmplt_epi8(_mm_xor_si128(digit,  bias), _mm_set1_epi8(char(0x80+10)));
+  __m128i isLetter = _mm_cmplt_epi8(_mm_xor_si128(letter, bias), _mm_set1_epi8(char(0x80+6)));
+
+  if(_mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) != 0xFFFF)
+    valid = false;
+
+  return _mm_or_si128(_mm_and_si128(isDigit, digit),
+                      _mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
 //##################################################################################################
-std::string tpToHex(const std::string& input)
+//! Combine pairs of nibbles (high, low) in each 16 bit lane into a byte in the low half of the lane.
+inline __m128i combineNibbles(__m128i n)
+{
+  __m128i high = _mm_and_si128(_mm_slli_epi16(n, 4), _mm_set1_epi16(0x00F0));
+  __m128i low  = _mm_srli_epi16(n, 8);
+  return _mm_or_si128(high, low);
+}
+#endif
+
+#ifdef __AVX2__
+//##################################################################################################
+inline __m256i nibblesToHex(__m256i n)
+{
+  __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(n, _mm256_set1_epi8(9)), _mm256_set1_epi8('A'-'0'-10));
+  return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')), letters);
+}
+
+//##################################################################################################
+inline __m256i hexToNibbles(__m256i c, bool& valid)
+{
+  __m256i digit  = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+  __m256i letter = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+  __m256i bias   = _mm256_set1_epi8(char(0x80));
+
+  __m256i isDigit  = _mm256_cmpgt_epi8(_mm256_set1_epi8(char(0x80+10)), _mm256_xor_si256(digit,  bias));
+  __m256i isLetter = _mm256_cmpgt_epi8(_mm256_set1_epi8(char(0x80+6)),  _mm256_xor_si256(letter, bias));
+
+  if(_mm256_movemask_epi8(_mm256_or_si256(isDigit, isLetter)) != -1)
+    valid = false;
+
+  return _mm256_or_si256(_mm256_and_si256(isDigit, digit),
+                         _mm256_and_si256(isLetter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+//##################################################################################################
+inline __m256i combineNibbles(__m256i n)
+{
+  __m256i high = _mm256_and_si256(_mm256_slli_epi16(n, 4), _mm256_set1_epi16(0x00F0));
+  __m256i low  = _mm256_srli_epi16(n, 8);
+  return _mm256_or_si256(high, low);
+}
+#endif
+}
+
+//##################################################################################################
+void tpToHex(const void* input, size_t size, char* output)
 {
   static const char* const lut = "0123456789ABCDEF";
 
-  size_t len = input.length();
-  const uint8_t* s = reinterpret_cast<const uint8_t*>(input.data());
-  const uint8_t* sMax = s + len;
+  const uint8_t* s = static_cast<const uint8_t*>(input);
+  const uint8_t* sMax = s + size;
 
-  std::string output;
-  output.reserve(2 * len);
+#ifdef __AVX2__
+  for(; (sMax-s)>=32; s+=32, output+=64)
+  {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+    __m256i high = nibblesToHex(_mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F)));
+    __m256i low  = nibblesToHex(_mm256_and_si256(v, _mm256_set1_epi8(0x0F)));
+
+    // The unpacks work within each 128 bit lane, so swap the lanes back into order.
+    __m256i a = _mm256_unpacklo_epi8(high, low);
+    __m256i b = _mm256_unpackhi_epi8(high, low);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output),    _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(output+32), _mm256_permute2x128_si256(a, b, 0x31));
+  }
+#endif
+
+#ifdef __SSE2__
+  for(; (sMax-s)>=16; s+=16, output+=32)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    __m128i high = nibblesToHex(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0F)));
+    __m128i low  = nibblesToHex(_mm_and_si128(v, _mm_set1_epi8(0x0F)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output),    _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(output+16), _mm_unpackhi_epi8(high, low));
+  }
+#endif
 
-  for (; s<sMax; s++)
+  for(; s<sMax; s++)
   {
     const unsigned char c = *s;
-    output.push_back(lut[c >> 4]);
-    output.push_back(lut[c & 15]);
+    *(output++) = lut[c >> 4];
+    *(output++) = lut[c & 15];
   }
+}
 
+//##################################################################################################
+std::string tpToHex(std::string_view input)
+{
+  std::string output;
+  output.resize(2 * input.size());
+  tpToHex(input.data(), input.size(), output.data());
   return output;
 }
 
 //##################################################################################################
-std::string tpFromHEX(const std::string& input)
+bool tpFromHEX(std::string_view input, void* output)
 {
-  static const char* const lut = "0123456789ABCDEF";
-  size_t len = input.length();
+  size_t len = input.size();
   if(len & 1)
-    return std::string();
+    return false;
 
-  std::string output;
-  output.resize(len / 2);
+  const uint8_t* s = reinterpret_cast<const uint8_t*>(input.data());
+  const uint8_t* sMax = s + len;
+  uint8_t* o = static_cast<uint8_t*>(output);
+
+  [[maybe_unused]] bool valid=true;
+
+#ifdef __AVX2__
+  for(; (sMax-s)>=32; s+=32, o+=16)
+  {
+    __m256i v = combineNibbles(hexToNibbles(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s)), valid));
 
-  uint8_t* o = reinterpret_cast<uint8_t*>(output.data());
+    // Pack works within each 128 bit lane, gather the low 64 bits of each lane.
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm256_castsi256_si128(packed));
+  }
+#endif
 
-  for (size_t i = 0; i < len; i+=2, o++)
+#ifdef __SSE2__
+  for(; (sMax-s)>=16; s+=16, o+=8)
   {
-    char a = input[i];
-    const char* p = std::lower_bound(lut, lut + 16, a);
-    if(*p != a)
-        return std::string();
+    __m128i v = combineNibbles(hexToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s)), valid));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(o), _mm_packus_epi16(v, v));
+  }
+
+  if(!valid)
+    return false;
+#endif
 
-    char b = input[i + 1];
-    const char* q = std::lower_bound(lut, lut + 16, b);
-    if(*q != b)
-      return std::string();
+  for(; s<sMax; s+=2, o++)
+  {
+    uint8_t a = hexDecodeTable.values[s[0]];
+    uint8_t b = hexDecodeTable.values[s[1]];
+    if((a|b) & 0xF0)
+      return false;
 
-    (*o) = uint8_t(((p - lut) << 4) | (q - lut));
+    (*o) = uint8_t((a << 4) | b);
   }
 
+  return true;
+}
+
+//##################################################################################################
+std::string tpFromHEX(std::string_view input)
+{
+  std::string output;
+  output.resize(input.size() / 2);
+  if(!tpFromHEX(input, output.data()))
+    return std::string();
   return output;
 }
 
@@ -70,69 +230,281 @@ bool tpEndsWith(const std::string& input, const std::string& s)
 }
 
 //##################################################################################################
-namespace
-{
-void addPart(std::vector<std::string>& result, const std::string& input, size_t pos, size_t n, tp_utils::SplitBehavior behavior)
+void tpSplit(std::vector<std::string>& result,
+             const std::string& input,
+             const std::string& del,
+             tp_utils::SplitBehavior behavior)
 {
-  if(behavior==tp_utils::SplitBehavior::SkipEmptyParts && n==0)
-    return;
-
-  result.push_back(input.substr(pos, n));
-}
+  for(std::string_view part : tpSplitView(input, std::string_view(del), behavior))
+    result.emplace_back(part);
 }
 
 //##################################################################################################
 void tpSplit(std::vector<std::string>& result,
              const std::string& input,
-             const std::string& del,
+             char del,
              tp_utils::SplitBehavior behavior)
 {
-  std::string::size_type start = 0;
-  auto end = input.find(del);
-  while (end != std::string::npos)
+  for(std::string_view part : tpSplitView(input, del, behavior))
+    result.emplace_back(part);
+}
+
+//##################################################################################################
+void tpRemoveChar(std::string& s, char c)
+{
+  s.erase(std::remove_if(s.begin(), s.end(), [c](int a){return a==c;}), s.end());
+}
+
+namespace tp_utils
+{
+
+//##################################################################################################
+size_t utf16LengthFromUTF8(const char* input, size_t size)
+{
+  const auto* s = reinterpret_cast<const uint8_t*>(input);
+  const auto* sMax = s + size;
+  size_t length=0;
+
+#ifdef __SSE2__
+  // Count the bytes that start a code point, plus one more for those that need a surrogate pair.
+  for(; (sMax-s)>=16; s+=16)
   {
-    addPart(result, input, start, end - start, behavior);
-    start = end + del.length();
-    end = input.find(del, start);
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    int leads = _mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(char(0xBF))));
+    int fours = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(char(0xF0))), v));
+    length += size_t(__builtin_popcount(unsigned(leads)) + __builtin_popcount(unsigned(fours)));
   }
+#endif
 
-  addPart(result, input, start, input.size()-start, behavior);
+  for(; s<sMax; s++)
+    length += size_t(((*s) & 0xC0) != 0x80) + size_t((*s) >= 0xF0);
+
+  return length;
 }
 
 //##################################################################################################
-void tpSplit(std::vector<std::string>& result,
-             const std::string& input,
-             char del,
-             tp_utils::SplitBehavior behavior)
+size_t utf8LengthFromUTF16(const char16_t* input, size_t size)
 {
-  std::string::size_type start = 0;
-  auto end = input.find(del);
-  while (end != std::string::npos)
+  size_t length=0;
+  for(const char16_t* s=input; s<input+size; s++)
   {
-    addPart(result, input, start, end - start, behavior);
-    start = end+1;
-    end = input.find(del, start);
+    auto c = uint16_t(*s);
+    length += 1 + size_t(c>=0x80) + size_t(c>=0x800 && (c<0xD800 || c>0xDFFF));
   }
+  return length;
+}
+
+//##################################################################################################
+UTFResult convertUTF8ToUTF16(const char* input, size_t size, char16_t* output)
+{
+  const auto* begin = reinterpret_cast<const uint8_t*>(input);
+  const auto* s = begin;
+  const auto* sMax = s + size;
+  char16_t* o = output;
 
-  addPart(result, input, start, input.size()-start, behavior);
+  auto fail = [&](UTFError error)
+  {
+    return UTFResult{error, size_t(s-begin), size_t(o-output)};
+  };
+
+  auto isContinuation = [](uint8_t c){return (c & 0xC0) == 0x80;};
+
+  while(s<sMax)
+  {
+#ifdef __SSE2__
+    // Widen blocks of ASCII to UTF-16 without decoding them.
+    while((sMax-s)>=16)
+    {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+      if(_mm_movemask_epi8(v))
+        break;
+
+      __m128i zero = _mm_setzero_si128();
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(o),   _mm_unpacklo_epi8(v, zero));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(o+8), _mm_unpackhi_epi8(v, zero));
+      s+=16;
+      o+=16;
+    }
+
+    if(s>=sMax)
+      break;
+#endif
+
+    uint8_t c = *s;
+    if(c < 0x80)
+    {
+      *(o++) = char16_t(c);
+      s++;
+      continue;
+    }
+
+    size_t n;
+    uint32_t cp;
+    uint8_t min=0x80;
+    uint8_t max=0xBF;
+
+    if(c < 0xC2)
+      return fail((c<0xC0)?UTFError::InvalidByte:UTFError::Overlong);
+    else if(c < 0xE0)
+    {
+      n=2;
+      cp = c & 0x1F;
+    }
+    else if(c < 0xF0)
+    {
+      n=3;
+      cp = c & 0x0F;
+      if(c==0xE0)
+        min=0xA0;
+      else if(c==0xED)
+        max=0x9F;
+    }
+    else if(c < 0xF5)
+    {
+      n=4;
+      cp = c & 0x07;
+      if(c==0xF0)
+        min=0x90;
+      else if(c==0xF4)
+        max=0x8F;
+    }
+    else
+      return fail((c<0xF8)?UTFError::TooLarge:UTFError::InvalidByte);
+
+    if(size_t(sMax-s) < n)
+      return fail(UTFError::Truncated);
+
+    uint8_t second = s[1];
+    if(!isContinuation(second))
+      return fail(UTFError::Truncated);
+
+    if(second<min)
+      return fail(UTFError::Overlong);
+
+    if(second>max)
+      return fail((c==0xED)?UTFError::Surrogate:UTFError::TooLarge);
+
+    cp = (cp<<6) | (second & 0x3F);
+    for(size_t i=2; i<n; i++)
+    {
+      if(!isContinuation(s[i]))
+        return fail(UTFError::Truncated);
+      cp = (cp<<6) | (s[i] & 0x3F);
+    }
+
+    if(cp < 0x10000)
+      *(o++) = char16_t(cp);
+    else
+    {
+      cp -= 0x10000;
+      *(o++) = char16_t(0xD800 + (cp>>10));
+      *(o++) = char16_t(0xDC00 + (cp & 0x3FF));
+    }
+
+    s+=n;
+  }
+
+  return UTFResult{UTFError::None, size, size_t(o-output)};
 }
 
 //##################################################################################################
-void tpRemoveChar(std::string& s, char c)
+UTFResult convertUTF16ToUTF8(const char16_t* input, size_t size, char* output)
 {
-  s.erase(std::remove_if(s.begin(), s.end(), [c](int a){return a==c;}), s.end());
+  const char16_t* s = input;
+  const char16_t* sMax = s + size;
+  auto* o = reinterpret_cast<uint8_t*>(output);
+
+  while(s<sMax)
+  {
+#ifdef __SSE2__
+    // Narrow blocks of ASCII to UTF-8 without encoding them.
+    while((sMax-s)>=16)
+    {
+      __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+      __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+8));
+      __m128i nonASCII = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16(int16_t(0xFF80)));
+      if(_mm_movemask_epi8(_mm_cmpeq_epi16(nonASCII, _mm_setzero_si128())) != 0xFFFF)
+        break;
+
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(o), _mm_packus_epi16(a, b));
+      s+=16;
+      o+=16;
+    }
+
+    if(s>=sMax)
+      break;
+#endif
+
+    auto c = uint32_t(uint16_t(*s));
+    if(c < 0x80)
+    {
+      *(o++) = uint8_t(c);
+    }
+    else if(c < 0x800)
+    {
+      *(o++) = uint8_t(0xC0 | (c>>6));
+      *(o++) = uint8_t(0x80 | (c & 0x3F));
+    }
+    else if(c<0xD800 || c>0xDFFF)
+    {
+      *(o++) = uint8_t(0xE0 | (c>>12));
+      *(o++) = uint8_t(0x80 | ((c>>6) & 0x3F));
+      *(o++) = uint8_t(0x80 | (c & 0x3F));
+    }
+    else
+    {
+      auto low = (s+1<sMax)?uint32_t(uint16_t(s[1])):0;
+      if(c>0xDBFF || low<0xDC00 || low>0xDFFF)
+        return UTFResult{UTFError::UnpairedSurrogate, size_t(s-input), size_t(o-reinterpret_cast<uint8_t*>(output))};
+
+      uint32_t cp = 0x10000 + ((c-0xD800)<<10) + (low-0xDC00);
+      *(o++) = uint8_t(0xF0 | (cp>>18));
+      *(o++) = uint8_t(0x80 | ((cp>>12) & 0x3F));
+      *(o++) = uint8_t(0x80 | ((cp>>6) & 0x3F));
+      *(o++) = uint8_t(0x80 | (cp & 0x3F));
+      s++;
+    }
+
+    s++;
+  }
+
+  return UTFResult{UTFError::None, size, size_t(o-reinterpret_cast<uint8_t*>(output))};
+}
+
 }
 
 //##################################################################################################
-std::string tpToUTF8(const std::u16string& source)
+std::string tpToUTF8(std::u16string_view source, tp_utils::UTFResult* result)
 {
-  return std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>().to_bytes(source);
+  std::string output;
+  output.resize(tp_utils::utf8LengthFromUTF16(source.data(), source.size()));
+  auto r = tp_utils::convertUTF16ToUTF8(source.data(), source.size(), output.data());
+
+  if(result)
+    *result = r;
+
+  if(r.error != tp_utils::UTFError::None)
+    return std::string();
+
+  output.resize(r.written);
+  return output;
 }
 
 //##################################################################################################
-std::u16string tpFromUTF8(const std::string& source)
+std::u16string tpFromUTF8(std::string_view source, tp_utils::UTFResult* result)
 {
-  return std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>().from_bytes(source);
+  std::u16string output;
+  output.resize(tp_utils::utf16LengthFromUTF8(source.data(), source.size()));
+  auto r = tp_utils::convertUTF8ToUTF16(source.data(), source.size(), output.data());
+
+  if(result)
+    *result = r;
+
+  if(r.error != tp_utils::UTFError::None)
+    return std::u16string();
+
+  output.resize(r.written);
+  return output;
 }
 
 namespace tp_utils
@@ -0,0 +1,17 @@
+#include "tp_utils/Interface.h"
+#include "tp_utils/MutexUtils.h"
+
+namespace tp_utils
+{
+
+//##################################################################################################
+size_t interfaceSlot(const char* typeName)
+{
+  static TPMutex mutex{TPM};
+  static std::unordered_map<std::string, size_t> slots;
+
+  TP_MUTEX_LOCKER(mutex);
+  return slots.emplace(typeName, slots.size()).first->second;
+}
+
+}
@@ -3,19 +3,46 @@
 namespace tp_utils
 {
 
+namespace
+{
+//##################################################################################################
+nlohmann::json* findArray(nlohmann::json& j, const std::string& key)
+{
+  if(!j.is_object())
+    return nullptr;
+
+  auto i = j.find(key);
+  return (i!=j.end() && i->is_array())?&(*i):nullptr;
+}
+}
+
 //##################################################################################################
 std::vector<std::string> getJSONStringList(const nlohmann::json& j,
                                            const std::string& key)
 {
   std::vector<std::string> result;
 
-  try
-  {
-    for(const nlohmann::json& i : j.value<nlohmann::json>(key, nlohmann::json()))
-      result.push_back(i);
-  }
-  catch(...)
+  const nlohmann::json& a = getJSONArrayRef(j, key);
+  result.reserve(a.size());
+  for(const nlohmann::json& i : a)
+    if(i.is_string())
+      result.push_back(i.get_ref<const std::string&>());
+
+  return result;
+}
+
+//##################################################################################################
+std::vector<std::string> getJSONStringList(nlohmann::json&& j,
+                                           const std::string& key)
+{
+  std::vector<std::string> result;
+
+  if(nlohmann::json* a = findArray(j, key); a)
   {
+    result.reserve(a->size());
+    for(nlohmann::json& i : *a)
+      if(i.is_string())
+        result.push_back(std::move(i.get_ref<std::string&>()));
   }
 
   return result;
@@ -25,18 +52,26 @@ std::vector<std::string> getJSONStringList(const nlohmann::json& j,
 std::vector<nlohmann::json> getJSONArray(const nlohmann::json& j,
                                          const std::string& key)
 {
-  std::vector<nlohmann::json> result;
+  return getJSONArrayRef(j, key).get_ref<const nlohmann::json::array_t&>();
+}
 
-  try
-  {
-    for(const nlohmann::json& i : j.value<nlohmann::json>(key, nlohmann::json()))
-      result.push_back(i);
-  }
-  catch(...)
-  {
-  }
+//##################################################################################################
+std::vector<nlohmann::json> getJSONArray(nlohmann::json&& j,
+                                         const std::string& key)
+{
+  if(nlohmann::json* a = findArray(j, key); a)
+    return std::move(a->get_ref<nlohmann::json::array_t&>());
 
-  return result;
+  return std::vector<nlohmann::json>();
+}
+
+//##################################################################################################
+const nlohmann::json& getJSONArrayRef(const nlohmann::json& j,
+                                      const std::string& key)
+{
+  static const nlohmann::json emptyArray = nlohmann::json::array();
+  const nlohmann::json* a = findJSONValue(j, key);
+  return (a && a->is_array())?*a:emptyArray;
 }
 
 }
@@ -2,13 +2,14 @@
 #include "tp_utils/DebugUtils.h"
 #include "tp_utils/TimeUtils.h"
 #include "tp_utils/FileUtils.h"
+#include "tp_utils/FlatHashMap.h"
+#include "tp_utils/SmallVector.h"
 
 #include "lib_platform/Polyfill.h"
 
 #include <condition_variable>
 #include <functional>
 #include <vector>
-#include <unordered_map>
 #include <thread>
 
 #define MUTEX_NAME_LEN 52
@@ -148,7 +149,7 @@ std::string fixedWidthKeepLeft(std::string data, size_t len, char pad)
 struct LockSiteDetails_lt
 {
   //locationID -> total elapsed time
-  std::unordered_map<int, int> blockedBy;
+  FlatHashMap<int, int> blockedBy;
 
   std::string name;
   int id{0};
@@ -187,7 +188,7 @@ struct MutexInstanceDetails_ls
   //This uses a list to cope with recursive mutexes
   //The locationID is where the mutex was locked
   //thread -> list of (locationID, timer)
-  std::unordered_map<std::thread::id, std::vector<std::pair<int, ElapsedTimer*> > > lockTimers;
+  FlatHashMap<std::thread::id, SmallVector<std::pair<int, ElapsedTimer*>, 2>> lockTimers;
 };
 
 //##################################################################################################
@@ -195,8 +196,8 @@ struct MutexInstanceDetails_ls
 struct MutexDefinitionDetails_lt
 {
   //locationID -> details
-  std::unordered_map<int, LockSiteDetails_lt> lockSiteDetails;
-  std::unordered_map<int, UnlockSiteDetails_lt> unlockSiteDetails;
+  FlatHashMap<int, LockSiteDetails_lt> lockSiteDetails;
+  FlatHashMap<int, UnlockSiteDetails_lt> unlockSiteDetails;
 
   std::string name;
   const char* type{nullptr};
@@ -218,11 +219,11 @@ struct LockStats::Private
   std::mutex mutex;
 
   int mutexInstanceCount{0};
-  std::unordered_map<int, MutexInstanceDetails_ls> mutexInstances;
+  FlatHashMap<int, MutexInstanceDetails_ls> mutexInstances;
 
   std::vector<MutexDefinitionDetails_lt> mutexDefinitions;
-  std::unordered_map<std::pair<const char*, int>, size_t> mutexDefinitionMap;
-  std::unordered_map<std::pair<const char*, int>, size_t> locationIDs;
+  FlatHashMap<std::pair<const char*, int>, size_t> mutexDefinitionMap;
+  FlatHashMap<std::pair<const char*, int>, size_t> locationIDs;
   size_t locationIDCount{0};
 
   //##################################################################################################
@@ -430,7 +431,7 @@ void LockStats::unlock(int id, const char* file, int line)
     bool empty=false;
     int lockLocationID=0;
     {
-      std::vector<std::pair<int, ElapsedTimer*>>& timerList = mutexInstanceDetails.lockTimers[threadID];
+      SmallVector<std::pair<int, ElapsedTimer*>, 2>& timerList = mutexInstanceDetails.lockTimers[threadID];
       if(!timerList.empty())
       {
         const auto& timer = tpTakeLast(timerList);
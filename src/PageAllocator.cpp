@@ -0,0 +1,151 @@
+#include "tp_utils/PageAllocator.h"
+
+#include "tp_utils/DebugUtils.h"
+
+#ifdef TDP_LINUX
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace tp_utils
+{
+
+#ifdef TDP_LINUX
+namespace
+{
+//##################################################################################################
+size_t roundUp(size_t size, size_t multiple)
+{
+  return multiple?(((size + multiple - 1) / multiple) * multiple):size;
+}
+
+//##################################################################################################
+size_t allocationSize(size_t size, HugePages hugePages)
+{
+  size_t multiple = (hugePages==HugePages::Yes)?hugePageSize():0;
+  if(!multiple)
+    multiple = pageSize();
+  return roundUp(size, multiple);
+}
+
+//##################################################################################################
+//! Returns false if the policy could not be set, the memory is still usable with the default policy.
+bool bindToNode(void* data, size_t size, int numaNode)
+{
+  // From linux/mempolicy.h, prefer the node but fall back to others rather than failing.
+  constexpr int mpolPreferred=1;
+  constexpr size_t maxNodes=1024;
+  constexpr size_t bitsPerWord=sizeof(unsigned long)*8;
+
+  if(numaNode<0)
+    return true;
+
+  if(size_t(numaNode)>=maxNodes)
+  {
+    errno = EINVAL;
+    return false;
+  }
+
+  unsigned long nodeMask[maxNodes/bitsPerWord]={};
+  nodeMask[size_t(numaNode)/bitsPerWord] = 1ul << (size_t(numaNode)%bitsPerWord);
+
+  // The kernel reads maxnode-1 bits of the mask, so like libnuma pass the mask size plus one.
+  return ::syscall(SYS_mbind, data, size, mpolPreferred, nodeMask, maxNodes+1, 0) == 0;
+}
+
+//##################################################################################################
+//! Map size bytes aligned to alignment by over allocating and trimming the ends.
+void* mapAligned(size_t size, size_t alignment)
+{
+  size_t mapSize = size + alignment;
+  void* mapping = ::mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(mapping == MAP_FAILED)
+    return nullptr;
+
+  auto begin = reinterpret_cast<uintptr_t>(mapping);
+  auto aligned = roundUp(begin, alignment);
+  auto end = begin + mapSize;
+
+  if(aligned > begin)
+    ::munmap(mapping, aligned-begin);
+
+  if(end > aligned+size)
+    ::munmap(reinterpret_cast<void*>(aligned+size), end-(aligned+size));
+
+  return reinterpret_cast<void*>(aligned);
+}
+}
+#endif
+
+//##################################################################################################
+void* allocatePages(size_t size, HugePages hugePages, int numaNode)
+{
+  if(size==0)
+    return nullptr;
+
+#ifdef TDP_LINUX
+  size = allocationSize(size, hugePages);
+  void* data = nullptr;
+
+  if(hugePages==HugePages::Yes && hugePageSize())
+  {
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(mapping != MAP_FAILED)
+      data = mapping;
+    else if(transparentHugePages()!=TransparentHugePages::Never &&
+            transparentHugePages()!=TransparentHugePages::Unavailable)
+    {
+      data = mapAligned(size, hugePageSize());
+      if(data)
+        ::madvise(data, size, MADV_HUGEPAGE);
+    }
+  }
+
+  if(!data)
+  {
+    void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mapping == MAP_FAILED)
+      return nullptr;
+    data = mapping;
+  }
+
+  if(!bindToNode(data, size, numaNode))
+    tpWarning() << "allocatePages: failed to bind memory to NUMA node " << numaNode << ": " << std::strerror(errno);
+
+  return data;
+#else
+  TP_UNUSED(hugePages);
+  TP_UNUSED(numaNode);
+  try
+  {
+    void* data = ::operator new(size, std::align_val_t(4096));
+    std::fill_n(static_cast<char*>(data), size, 0);
+    return data;
+  }
+  catch(...)
+  {
+    return nullptr;
+  }
+#endif
+}
+
+//##################################################################################################
+void freePages(void* data, size_t size, HugePages hugePages)
+{
+  if(!data)
+    return;
+
+#ifdef TDP_LINUX
+  ::munmap(data, allocationSize(size, hugePages));
+#else
+  TP_UNUSED(size);
+  TP_UNUSED(hugePages);
+  ::operator delete(data, std::align_val_t(4096));
+#endif
+}
+
+}
@@ -0,0 +1,119 @@
+#include "tp_utils/PageSize.h"
+
+#ifdef TDP_LINUX
+#include <fstream>
+#include <sys/auxv.h>
+#include <unistd.h>
+#endif
+
+namespace tp_utils
+{
+
+#ifdef TDP_LINUX //=================================================================================
+
+namespace
+{
+//##################################################################################################
+size_t readPageSize()
+{
+  if(auto size = size_t(getauxval(AT_PAGESZ)); size)
+    return size;
+
+  long size = sysconf(_SC_PAGESIZE);
+  return size>0?size_t(size):0;
+}
+
+//##################################################################################################
+size_t readHugePageSize()
+{
+  std::ifstream meminfo("/proc/meminfo");
+  std::string line;
+  while(std::getline(meminfo, line))
+  {
+    if(tpStartsWith(line, "Hugepagesize:"))
+    {
+      try
+      {
+        return size_t(std::stoull(line.substr(13))) * 1024;
+      }
+      catch(...)
+      {
+        break;
+      }
+    }
+  }
+
+  size_t size=0;
+  std::ifstream pmdSize("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+  if(pmdSize >> size)
+    return size;
+
+  return 0;
+}
+
+//##################################################################################################
+//! The active mode is shown in brackets, for example "always [madvise] never".
+TransparentHugePages readTransparentHugePages()
+{
+  std::ifstream enabled("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::string line;
+  if(!std::getline(enabled, line))
+    return TransparentHugePages::Unavailable;
+
+  if(line.find("[always]") != std::string::npos)
+    return TransparentHugePages::Always;
+
+  if(line.find("[madvise]") != std::string::npos)
+    return TransparentHugePages::MAdvise;
+
+  if(line.find("[never]") != std::string::npos)
+    return TransparentHugePages::Never;
+
+  return TransparentHugePages::Unavailable;
+}
+}
+
+//##################################################################################################
+size_t pageSize()
+{
+  static const size_t size = readPageSize();
+  return size;
+}
+
+//##################################################################################################
+size_t hugePageSize()
+{
+  static const size_t size = readHugePageSize();
+  return size;
+}
+
+//##################################################################################################
+TransparentHugePages transparentHugePages()
+{
+  static const TransparentHugePages mode = readTransparentHugePages();
+  return mode;
+}
+
+#else //============================================================================================
+
+//##################################################################################################
+size_t pageSize()
+{
+  return 0;
+}
+
+//##################################################################################################
+size_t hugePageSize()
+{
+  return 0;
+}
+
+//##################################################################################################
+TransparentHugePages transparentHugePages()
+{
+  return TransparentHugePages::Unavailable;
+}
+
+#endif
+
+}
@@ -0,0 +1,313 @@
+#include "tp_utils/PixelConversions.h"
+
+#include <cstring>
+#include <thread>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace tp_utils
+{
+
+namespace
+{
+//##################################################################################################
+//! Call convertRow for each row, splitting the rows into bands across threads for large images.
+template<typename T>
+void forEachRowParallel(size_t width, size_t height, size_t threads, const T& convertRow)
+{
+  auto convertRows = [&](size_t y0, size_t y1)
+  {
+    for(size_t y=y0; y<y1; y++)
+      convertRow(y);
+  };
+
+  if(threads==0)
+    threads = tpMax(size_t(std::thread::hardware_concurrency()), size_t(1));
+
+  threads = tpMin(threads, height);
+  threads = tpMin(threads, tpMax((width*height) / parallelThreshold(), size_t(1)));
+
+  if(threads<2)
+  {
+    convertRows(0, height);
+    return;
+  }
+
+  std::vector<std::thread> workers;
+  workers.reserve(threads-1);
+  size_t band = (height + threads - 1) / threads;
+  for(size_t y=band; y<height; y+=band)
+    workers.emplace_back(convertRows, y, tpMin(y+band, height));
+
+  convertRows(0, band);
+
+  for(auto& worker : workers)
+    worker.join();
+}
+
+#ifdef __SSE2__
+//##################################################################################################
+inline __m128i loadPixels(const TPPixel* p)
+{
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+//##################################################################################################
+//! Pack 32 bit lanes holding values up to 0xFFFF into 16 bit lanes.
+inline __m128i packUnsigned32(__m128i a, __m128i b)
+{
+  const __m128i bias32 = _mm_set1_epi32(0x8000);
+  const __m128i bias16 = _mm_set1_epi16(int16_t(0x8000));
+  return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32)), bias16);
+}
+#endif
+
+//##################################################################################################
+void rowToRGB565(const TPPixel* s, uint16_t* d, size_t width)
+{
+  size_t x=0;
+
+#ifdef __SSE2__
+  auto convert = [](__m128i v)
+  {
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, _mm_set1_epi32(0xF8)), 8);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x07E0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 19), _mm_set1_epi32(0x001F));
+    return _mm_or_si128(r, _mm_or_si128(g, b));
+  };
+
+  for(; x+8<=width; x+=8)
+  {
+    __m128i packed = packUnsigned32(convert(loadPixels(s+x)), convert(loadPixels(s+x+4)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x), packed);
+  }
+#endif
+
+  for(; x<width; x++)
+    d[x] = uint16_t(((s[x].r>>3)<<11) | ((s[x].g>>2)<<5) | (s[x].b>>3));
+}
+
+//##################################################################################################
+void rowFromRGB565(const uint16_t* s, TPPixel* d, size_t width)
+{
+  size_t x=0;
+
+#ifdef __SSE2__
+  auto convert = [](__m128i v)
+  {
+    __m128i r = _mm_and_si128(_mm_srli_epi32(v, 11), _mm_set1_epi32(0x1F));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x3F));
+    __m128i b = _mm_and_si128(v, _mm_set1_epi32(0x1F));
+
+    // Replicate the high bits into the low bits so that full intensity maps to 255.
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+
+    __m128i rgba = _mm_or_si128(r, _mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(b, 16)));
+    return _mm_or_si128(rgba, _mm_set1_epi32(int32_t(0xFF000000)));
+  };
+
+  const __m128i zero = _mm_setzero_si128();
+  for(; x+8<=width; x+=8)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+x));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x),   convert(_mm_unpacklo_epi16(v, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x+4), convert(_mm_unpackhi_epi16(v, zero)));
+  }
+#endif
+
+  for(; x<width; x++)
+  {
+    uint32_t r = (s[x]>>11) & 0x1F;
+    uint32_t g = (s[x]>>5) & 0x3F;
+    uint32_t b = s[x] & 0x1F;
+    d[x] = TPPixel(uint8_t((r<<3)|(r>>2)), uint8_t((g<<2)|(g>>4)), uint8_t((b<<3)|(b>>2)));
+  }
+}
+
+//##################################################################################################
+void rowToGray(const TPPixel* s, uint8_t* d, size_t width)
+{
+  size_t x=0;
+
+#ifdef __SSE2__
+  auto convert = [](__m128i v)
+  {
+    // Each product and the sum fit in the low 16 bits of each 32 bit lane.
+    __m128i r = _mm_and_si128(v, _mm_set1_epi32(0xFF));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), _mm_set1_epi32(0xFF));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), _mm_set1_epi32(0xFF));
+    __m128i y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi32(77)), _mm_mullo_epi16(g, _mm_set1_epi32(150)));
+    y = _mm_add_epi16(y, _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi32(29)), _mm_set1_epi32(128)));
+    return _mm_srli_epi32(_mm_and_si128(y, _mm_set1_epi32(0xFFFF)), 8);
+  };
+
+  for(; x+16<=width; x+=16)
+  {
+    __m128i a = _mm_packs_epi32(convert(loadPixels(s+x)),   convert(loadPixels(s+x+4)));
+    __m128i b = _mm_packs_epi32(convert(loadPixels(s+x+8)), convert(loadPixels(s+x+12)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x), _mm_packus_epi16(a, b));
+  }
+#endif
+
+  for(; x<width; x++)
+    d[x] = uint8_t((77u*s[x].r + 150u*s[x].g + 29u*s[x].b + 128u) >> 8);
+}
+
+//##################################################################################################
+void rowFromGray(const uint8_t* s, TPPixel* d, size_t width)
+{
+  size_t x=0;
+
+#ifdef __SSE2__
+  auto convert = [](__m128i v)
+  {
+    return _mm_or_si128(_mm_or_si128(v, _mm_slli_epi32(v, 8)),
+                        _mm_or_si128(_mm_slli_epi32(v, 16), _mm_set1_epi32(int32_t(0xFF000000))));
+  };
+
+  const __m128i zero = _mm_setzero_si128();
+  for(; x+16<=width; x+=16)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s+x));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x),    convert(_mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x+4),  convert(_mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x+8),  convert(_mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x+12), convert(_mm_unpackhi_epi16(hi, zero)));
+  }
+#endif
+
+  for(; x<width; x++)
+    d[x] = TPPixel(s[x], s[x], s[x]);
+}
+
+//##################################################################################################
+void rowToFloat(const TPPixel* s, TPPixelF* d, size_t width)
+{
+  size_t x=0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128 scale = _mm_set1_ps(1.0f/255.0f);
+  auto store = [&](size_t i, __m128i v)
+  {
+    _mm_storeu_ps(&d[i].r, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  };
+
+  for(; x+4<=width; x+=4)
+  {
+    __m128i v = loadPixels(s+x);
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    store(x,   _mm_unpacklo_epi16(lo, zero));
+    store(x+1, _mm_unpackhi_epi16(lo, zero));
+    store(x+2, _mm_unpacklo_epi16(hi, zero));
+    store(x+3, _mm_unpackhi_epi16(hi, zero));
+  }
+#endif
+
+  for(; x<width; x++)
+  {
+    d[x].r = float(s[x].r) / 255.0f;
+    d[x].g = float(s[x].g) / 255.0f;
+    d[x].b = float(s[x].b) / 255.0f;
+    d[x].a = float(s[x].a) / 255.0f;
+  }
+}
+
+//##################################################################################################
+void rowFromFloat(const TPPixelF* s, TPPixel* d, size_t width)
+{
+  size_t x=0;
+
+#ifdef __SSE2__
+  const __m128 scale = _mm_set1_ps(255.0f);
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 max = _mm_set1_ps(255.0f);
+  const __m128 min = _mm_setzero_ps();
+  auto load = [&](size_t i)
+  {
+    __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&s[i].r), scale), half);
+    return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, min), max));
+  };
+
+  for(; x+4<=width; x+=4)
+  {
+    __m128i lo = _mm_packs_epi32(load(x),   load(x+1));
+    __m128i hi = _mm_packs_epi32(load(x+2), load(x+3));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d+x), _mm_packus_epi16(lo, hi));
+  }
+#endif
+
+  auto convert = [](float c)
+  {
+    return uint8_t(tpMin(tpMax(c*255.0f + 0.5f, 0.0f), 255.0f));
+  };
+
+  for(; x<width; x++)
+    d[x] = TPPixel(convert(s[x].r), convert(s[x].g), convert(s[x].b), convert(s[x].a));
+}
+
+//##################################################################################################
+void rowToBGRA(const TPPixel* s, TPPixel* d, size_t width)
+{
+  if(s != d)
+    std::memcpy(d, s, width*sizeof(TPPixel));
+  swapRedBlue(d, width);
+}
+}
+
+//##################################################################################################
+void convertToRGB565(const TPPixelView& src, const PixelView<uint16_t>& dst, size_t threads)
+{
+  forEachRowParallel(src.width, src.height, threads, [&](size_t y){rowToRGB565(src.row(y), dst.row(y), src.width);});
+}
+
+//##################################################################################################
+void convertFromRGB565(const PixelView<const uint16_t>& src, const TPPixelView& dst, size_t threads)
+{
+  forEachRowParallel(src.width, src.height, threads, [&](size_t y){rowFromRGB565(src.row(y), dst.row(y), src.width);});
+}
+
+//##################################################################################################
+void convertToGray(const TPPixelView& src, const PixelView<uint8_t>& dst, size_t threads)
+{
+  forEachRowParallel(src.width, src.height, threads, [&](size_t y){rowToGray(src.row(y), dst.row(y), src.width);});
+}
+
+//##################################################################################################
+void convertFromGray(const PixelView<const uint8_t>& src, const TPPixelView& dst, size_t threads)
+{
+  forEachRowParallel(src.width, src.height, threads, [&](size_t y){rowFromGray(src.row(y), dst.row(y), src.width);});
+}
+
+//##################################################################################################
+void convertToFloat(const TPPixelView& src, const PixelView<TPPixelF>& dst, size_t threads)
+{
+  forEachRowParallel(src.width, src.height, threads, [&](size_t y){rowToFloat(src.row(y), dst.row(y), src.width);});
+}
+
+//##################################################################################################
+void convertFromFloat(const PixelView<const TPPixelF>& src, const TPPixelView& dst, size_t threads)
+{
+  forEachRowParallel(src.width, src.height, threads, [&](size_t y){rowFromFloat(src.row(y), dst.row(y), src.width);});
+}
+
+//##################################################################################################
+void convertToBGRA(const TPPixelView& src, const TPPixelView& dst, size_t threads)
+{
+  forEachRowParallel(src.width, src.height, threads, [&](size_t y){rowToBGRA(src.row(y), dst.row(y), src.width);});
+}
+
+//##################################################################################################
+size_t parallelThreshold()
+{
+  return 256*1024;
+}
+
+}
@@ -20,7 +20,7 @@ class StaticDetails_lt
 {
 public:
   std::mutex mutex;
-  std::unordered_map<tp_utils::StringID, InstanceDetails> instances;
+  tp_utils::StringIDMap<InstanceDetails> instances;
 
   //################################################################################################
   std::vector<std::string> serialize()
@@ -120,7 +120,7 @@ void RefCount::unlock()
 }
 
 //##################################################################################################
-const std::unordered_map<tp_utils::StringID, InstanceDetails>& RefCount::instances()
+const tp_utils::StringIDMap<InstanceDetails>& RefCount::instances()
 {
   if(staticDetails().mutex.try_lock())
   {
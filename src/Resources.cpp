@@ -1,34 +1,431 @@
 #include "tp_utils/Resources.h"
+#include "tp_utils/MutexUtils.h"
+
+#include <atomic>
+#include <cstring>
+#include <list>
 
 namespace tp_utils
 {
 
+//##################################################################################################
+ResourceBuffer::ResourceBuffer(const char* data, size_t size)
+{
+  // The get area is never written to, the cast is only needed to satisfy the streambuf interface.
+  auto begin = const_cast<char*>(data);
+  setg(begin, begin, begin+size);
+}
+
+//##################################################################################################
+ResourceBuffer::pos_type ResourceBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+  if(!(which & std::ios_base::in))
+    return pos_type(off_type(-1));
+
+  off_type base=0;
+  if(dir == std::ios_base::cur)
+    base = gptr()-eback();
+  else if(dir == std::ios_base::end)
+    base = egptr()-eback();
+
+  off_type pos = base + off;
+  if(pos<0 || pos>(egptr()-eback()))
+    return pos_type(off_type(-1));
+
+  setg(eback(), eback()+pos, egptr());
+  return pos_type(pos);
+}
+
+//##################################################################################################
+ResourceBuffer::pos_type ResourceBuffer::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
 //##################################################################################################
 ResourceStream::ResourceStream(const Resource& resource):
-  std::istringstream(std::string(resource.data, resource.size))
+  detail::ResourceStreamBuffer{ResourceBuffer(resource.data, resource.size), resource.owner},
+  std::istream(&buffer)
+{
+
+}
+
+namespace
+{
+//##################################################################################################
+//! An immutable open addressing hash table built once from the statically registered resources.
+class FrozenResources
+{
+  struct Slot
+  {
+    size_t hash{0};
+    std::string name;
+    Resource resource;
+    bool used{false};
+
+    //! Set when the resource is replaced by a later addResource().
+    std::atomic_bool replaced{false};
+  };
+
+  std::unique_ptr<Slot[]> m_slots;
+  size_t m_mask{0};
+
+public:
+  //################################################################################################
+  FrozenResources(const std::unordered_map<std::string, Resource>& resources)
+  {
+    size_t capacity=1;
+    while(capacity < resources.size()*2)
+      capacity*=2;
+
+    m_slots.reset(new Slot[capacity]);
+    m_mask = capacity-1;
+
+    for(const auto& i : resources)
+    {
+      size_t hash = std::hash<std::string_view>()(i.first);
+      size_t index = hash & m_mask;
+      while(m_slots[index].used)
+        index = (index+1) & m_mask;
+
+      auto& slot = m_slots[index];
+      slot.hash = hash;
+      slot.name = i.first;
+      slot.resource = i.second;
+      slot.used = true;
+    }
+  }
+
+  //################################################################################################
+  template<typename T>
+  void forEach(const T& closure) const
+  {
+    for(size_t i=0; i<=m_mask; i++)
+      if(m_slots[i].used && !m_slots[i].replaced)
+        closure(m_slots[i].name, m_slots[i].resource);
+  }
+
+  //################################################################################################
+  Slot* find(std::string_view name) const
+  {
+    size_t hash = std::hash<std::string_view>()(name);
+    for(size_t index = hash & m_mask; m_slots[index].used; index = (index+1) & m_mask)
+    {
+      auto& slot = m_slots[index];
+      if(slot.hash == hash && slot.name == name)
+        return &slot;
+    }
+    return nullptr;
+  }
+};
+
+//##################################################################################################
+struct ResourceRegistry
 {
+  TPMutex mutex{TPM};
+
+  //! Published once, after which it is never modified or freed.
+  std::atomic<FrozenResources*> frozen{nullptr};
 
+  //! Resources added before freezing, then resources added after freezing.
+  std::unordered_map<std::string, Resource> dynamic;
+  std::atomic_bool hasDynamic{false};
+
+  //################################################################################################
+  FrozenResources* freeze()
+  {
+    if(auto f = frozen.load(std::memory_order_acquire); f)
+      return f;
+
+    TP_MUTEX_LOCKER(mutex);
+    auto f = frozen.load(std::memory_order_relaxed);
+    if(!f)
+    {
+      f = new FrozenResources(dynamic);
+      dynamic.clear();
+      hasDynamic = false;
+      frozen.store(f, std::memory_order_release);
+    }
+    return f;
+  }
+};
+
+//##################################################################################################
+ResourceRegistry& resourceRegistry()
+{
+  static ResourceRegistry resourceRegistry;
+  return resourceRegistry;
+}
 }
 
 //##################################################################################################
-std::unordered_map<std::string, Resource>& resources()
+std::unordered_map<std::string, Resource> resources()
 {
-  static std::unordered_map<std::string, Resource> resources;
+  auto& r = resourceRegistry();
+  auto frozen = r.freeze();
+
+  std::unordered_map<std::string, Resource> resources;
+  frozen->forEach([&](const std::string& name, const Resource& resource)
+  {
+    resources[name] = resource;
+  });
+
+  TP_MUTEX_LOCKER(r.mutex);
+  for(const auto& i : r.dynamic)
+    resources[i.first] = i.second;
+
   return resources;
 }
 
+namespace
+{
+//##################################################################################################
+//! Decompress an LZ4 block, every read and write is bounds checked so bad input can not overrun.
+bool decompressLZ4(const char* src, size_t srcSize, char* dst, size_t dstSize)
+{
+  auto ip = reinterpret_cast<const uint8_t*>(src);
+  auto ipEnd = ip + srcSize;
+  auto op = reinterpret_cast<uint8_t*>(dst);
+  auto opBegin = op;
+  auto opEnd = op + dstSize;
+
+  auto readLength = [&](size_t length, size_t& result)
+  {
+    result = length;
+    if(length != 15)
+      return true;
+
+    uint8_t b;
+    do
+    {
+      if(ip >= ipEnd)
+        return false;
+      b = *(ip++);
+      result += b;
+    }
+    while(b == 255);
+    return true;
+  };
+
+  while(ip < ipEnd)
+  {
+    uint8_t token = *(ip++);
+
+    size_t literals;
+    if(!readLength(token>>4, literals) || literals>size_t(ipEnd-ip) || literals>size_t(opEnd-op))
+      return false;
+
+    std::memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+
+    // The last sequence only contains literals.
+    if(ip == ipEnd)
+      break;
+
+    if(ipEnd-ip < 2)
+      return false;
+
+    size_t offset = size_t(ip[0]) | (size_t(ip[1])<<8);
+    ip += 2;
+    if(offset==0 || offset>size_t(op-opBegin))
+      return false;
+
+    size_t match;
+    if(!readLength(token & 15, match))
+      return false;
+
+    match += 4;
+    if(match>size_t(opEnd-op))
+      return false;
+
+    // Matches can overlap the output they are copied to so copy a byte at a time.
+    const uint8_t* m = op - offset;
+    for(size_t i=0; i<match; i++)
+      op[i] = m[i];
+    op += match;
+  }
+
+  return op == opEnd;
+}
+
+//##################################################################################################
+struct CompressedResource
+{
+  const char* data{nullptr};
+  size_t size{0};
+  size_t uncompressedSize{0};
+  ResourceCompression compression{ResourceCompression::LZ4};
+};
+
+//##################################################################################################
+struct ResourceCache
+{
+  TPMutex mutex{TPM};
+  std::unordered_map<std::string, CompressedResource> compressed;
+  std::unordered_map<int, ResourceDecompressor> decompressors{{int(ResourceCompression::LZ4), decompressLZ4}};
+
+  size_t limit{64*1024*1024};
+  size_t cachedSize{0};
+
+  //! Most recently used at the front.
+  std::list<std::string> order;
+
+  struct Entry
+  {
+    std::shared_ptr<const std::string> data;
+    std::list<std::string>::iterator position;
+  };
+  std::unordered_map<std::string, Entry> cache;
+
+  //################################################################################################
+  //! Evict least recently used entries until the cache fits within its limit, keeping keep.
+  void evict(const std::string& keep)
+  {
+    while(cachedSize>limit && !order.empty())
+    {
+      const auto& name = order.back();
+      if(name == keep)
+        break;
+
+      auto i = cache.find(name);
+      cachedSize -= i->second.data->size();
+      cache.erase(i);
+      order.pop_back();
+    }
+  }
+};
+
+//##################################################################################################
+ResourceCache& resourceCache()
+{
+  static ResourceCache resourceCache;
+  return resourceCache;
+}
+
+//##################################################################################################
+Resource decompressedResource(const std::string& name)
+{
+  auto& c = resourceCache();
+
+  CompressedResource compressed;
+  ResourceDecompressor decompressor;
+  {
+    TP_MUTEX_LOCKER(c.mutex);
+    if(auto i = c.cache.find(name); i != c.cache.end())
+    {
+      c.order.splice(c.order.begin(), c.order, i->second.position);
+      const auto& data = i->second.data;
+      return Resource{data->data(), data->size(), data};
+    }
+
+    auto i = c.compressed.find(name);
+    if(i == c.compressed.end())
+      return Resource();
+
+    compressed = i->second;
+    decompressor = tpGetMapValue(c.decompressors, int(compressed.compression));
+  }
+
+  if(!decompressor)
+    return Resource();
+
+  // Decompress without holding the lock so that other resources can be looked up meanwhile.
+  auto data = std::make_shared<std::string>();
+  data->resize(compressed.uncompressedSize);
+  if(!decompressor(compressed.data, compressed.size, data->data(), data->size()))
+    return Resource();
+
+  TP_MUTEX_LOCKER(c.mutex);
+  auto& entry = c.cache[name];
+  if(!entry.data)
+  {
+    entry.data = data;
+    c.order.push_front(name);
+    entry.position = c.order.begin();
+    c.cachedSize += data->size();
+    c.evict(name);
+  }
+
+  return Resource{entry.data->data(), entry.data->size(), entry.data};
+}
+}
+
 //##################################################################################################
-Resource resource(const std::string& name)
+Resource resource(std::string_view name)
 {
-  return tpGetMapValue(resources(), name);
+  auto& r = resourceRegistry();
+  auto slot = r.freeze()->find(name);
+  if(slot && !slot->replaced.load(std::memory_order_acquire))
+    return slot->resource;
+
+  std::string key(name);
+  if(slot || r.hasDynamic.load(std::memory_order_acquire))
+  {
+    TP_MUTEX_LOCKER(r.mutex);
+    if(auto i = r.dynamic.find(key); i != r.dynamic.end())
+      return i->second;
+  }
+
+  return decompressedResource(key);
 }
 
 //##################################################################################################
 void addResource(const std::string& name, const char* data, size_t size)
 {
-  auto& r = resources()[name];
-  r.data = data;
-  r.size = size;
+  auto& r = resourceRegistry();
+  TP_MUTEX_LOCKER(r.mutex);
+
+  auto& resource = r.dynamic[name];
+  resource.data = data;
+  resource.size = size;
+  r.hasDynamic.store(true, std::memory_order_release);
+
+  if(auto frozen = r.frozen.load(std::memory_order_acquire); frozen)
+    if(auto slot = frozen->find(name); slot)
+      slot->replaced.store(true, std::memory_order_release);
+}
+
+//##################################################################################################
+void freezeResources()
+{
+  resourceRegistry().freeze();
+}
+
+//##################################################################################################
+void setResourceDecompressor(ResourceCompression compression, const ResourceDecompressor& decompressor)
+{
+  auto& c = resourceCache();
+  TP_MUTEX_LOCKER(c.mutex);
+  c.decompressors[int(compression)] = decompressor;
+}
+
+//##################################################################################################
+void addCompressedResource(const std::string& name,
+                           const char* data,
+                           size_t size,
+                           size_t uncompressedSize,
+                           ResourceCompression compression)
+{
+  auto& c = resourceCache();
+  TP_MUTEX_LOCKER(c.mutex);
+  c.compressed[name] = CompressedResource{data, size, uncompressedSize, compression};
+
+  if(auto i = c.cache.find(name); i != c.cache.end())
+  {
+    c.cachedSize -= i->second.data->size();
+    c.order.erase(i->second.position);
+    c.cache.erase(i);
+  }
+}
+
+//##################################################################################################
+void setResourceCacheLimit(size_t bytes)
+{
+  auto& c = resourceCache();
+  TP_MUTEX_LOCKER(c.mutex);
+  c.limit = bytes;
+  c.evict(std::string());
 }
 
 }
@@ -1,10 +1,8 @@
 #include "tp_utils/StringID.h"
 #include "tp_utils/StringIDManager.h"
 #include "tp_utils/MutexUtils.h"
+#include "tp_utils/FlatHashMap.h"
 
-#include <unordered_map>
-
-#include <map>
 #include <mutex>
 
 namespace tp_utils
@@ -14,8 +12,20 @@ namespace tp_utils
 struct StringID::StaticData
 {
   TPMutex mutex{TPM};
-  std::map<StringIDManager*, std::map<int64_t, SharedData*>> managers;
-  std::map<std::string, SharedData*> allKeys;
+  FlatHashMap<StringIDManager*, FlatHashMap<int64_t, SharedData*>> managers;
+  FlatHashMap<std::string, SharedData*> allKeys;
+
+  //index -> shared data, index 0 is reserved for invalid StringID's
+  std::vector<SharedData*> indexes{nullptr};
+  std::vector<size_t> freeIndexes;
+
+  //################################################################################################
+  //! Create the shared data for a new string, mutex must be locked.
+  SharedData* create(const std::string& keyString);
+
+  //################################################################################################
+  //! Remove the shared data from the tables, release its index, and delete it.
+  void destroy(SharedData* sd);
 };
 
 //##################################################################################################
@@ -24,16 +34,52 @@ struct StringID::SharedData
   TPMutex mutex{TPM};
 
   std::string keyString;
-  std::map<StringIDManager*, int64_t> keys;
+  FlatHashMap<StringIDManager*, int64_t> keys;
 
   int referenceCount{0};
 
+  size_t index{0};
+
   SharedData(std::string keyString_):
     keyString(std::move(keyString_))
   {
   }
 };
 
+//##################################################################################################
+StringID::SharedData* StringID::StaticData::create(const std::string& keyString)
+{
+  auto sd = new SharedData(keyString);
+
+  if(freeIndexes.empty())
+  {
+    sd->index = indexes.size();
+    indexes.push_back(sd);
+  }
+  else
+  {
+    sd->index = tpTakeLast(freeIndexes);
+    indexes[sd->index] = sd;
+  }
+
+  allKeys[keyString] = sd;
+  return sd;
+}
+
+//##################################################################################################
+void StringID::StaticData::destroy(SharedData* sd)
+{
+  allKeys.erase(sd->keyString);
+
+  for(const auto& i : sd->keys)
+    managers[i.first].erase(i.second);
+
+  indexes[sd->index] = nullptr;
+  freeIndexes.push_back(sd->index);
+
+  delete sd;
+}
+
 //##################################################################################################
 StringID::StringID():
   sd(nullptr)
@@ -53,6 +99,13 @@ StringID::StringID(const StringID& other):
   }
 }
 
+//##################################################################################################
+StringID::StringID(StringID&& other) noexcept:
+  sd(other.sd)
+{
+  other.sd = nullptr;
+}
+
 //##################################################################################################
 StringID::StringID(StringIDManager* manager, int64_t key):
   sd(nullptr)
@@ -63,11 +116,7 @@ StringID::StringID(StringIDManager* manager, int64_t key):
   StaticData& staticData(StringID::staticData());
   staticData.mutex.lock(TPM);
 
-  std::map<int64_t, SharedData*>& managerKeys = staticData.managers[manager];
-  {
-    auto i = managerKeys.find(key);
-    sd = (i == managerKeys.cend())?nullptr:(*i).second;
-  }
+  sd = tpGetMapValue(staticData.managers[manager], key);
 
   if(!sd)
   {
@@ -78,18 +127,16 @@ StringID::StringID(StringIDManager* manager, int64_t key):
 
     if(!keyString.empty())
     {
-      //std::map<std::string, SharedData*> allKeys;
-
       sd = tpGetMapValue(staticData.allKeys, keyString);
 
       if(!sd)
       {
-        sd = new SharedData(keyString);
-        staticData.allKeys[keyString] = sd;
+        sd = staticData.create(keyString);
       }
 
+      // Look the manager up again, the table may have been rehashed while it was unlocked.
       sd->keys[manager] = key;
-      managerKeys[key] = sd;
+      staticData.managers[manager][key] = sd;
     }
   }
 
@@ -118,8 +165,7 @@ StringID::StringID(const std::string& keyString):
 
   if(!sd)
   {
-    sd = new SharedData(keyString);
-    staticData.allKeys[keyString] = sd;
+    sd = staticData.create(keyString);
   }
 
   if(sd)
@@ -147,8 +193,7 @@ StringID::StringID(const char* keyString_):
 
   if(!sd)
   {
-    sd = new SharedData(keyString);
-    staticData.allKeys[keyString] = sd;
+    sd = staticData.create(keyString);
   }
 
   if(sd)
@@ -178,13 +223,8 @@ StringID& StringID::operator=(const StringID& other)
     //Delete unused shared data
     if(!sd->referenceCount)
     {
-      staticData.allKeys.erase(sd->keyString);
-
-      for (const auto& i : sd->keys)
-        staticData.managers[i.first].erase(i.second);
-
       sd->mutex.unlock(TPM);
-      delete sd;
+      staticData.destroy(sd);
     }
     else
       sd->mutex.unlock(TPM);
@@ -204,6 +244,19 @@ StringID& StringID::operator=(const StringID& other)
   return *this;
 }
 
+//##################################################################################################
+StringID& StringID::operator=(StringID&& other) noexcept
+{
+  if(&other != this)
+  {
+    StringID old(std::move(*this));
+    sd = other.sd;
+    other.sd = nullptr;
+  }
+
+  return *this;
+}
+
 //##################################################################################################
 StringID::~StringID()
 {
@@ -219,13 +272,8 @@ StringID::~StringID()
   //Delete unused shared data
   if(!sd->referenceCount)
   {
-    staticData.allKeys.erase(sd->keyString);
-
-    for(const auto& i : sd->keys)
-      staticData.managers[i.first].erase(i.second);
-
     sd->mutex.unlock(TPM);
-    delete sd;
+    staticData.destroy(sd);
   }
   else
     sd->mutex.unlock(TPM);
@@ -291,6 +339,66 @@ bool StringID::isValid()const
   return sd!=nullptr;
 }
 
+//##################################################################################################
+size_t StringID::index()const
+{
+  return sd?sd->index:0;
+}
+
+//##################################################################################################
+StringID StringID::fromIndex(size_t index)
+{
+  StringID stringID;
+
+  StaticData& staticData(StringID::staticData());
+  TP_MUTEX_LOCKER(staticData.mutex);
+
+  if(index<staticData.indexes.size())
+  {
+    stringID.sd = staticData.indexes.at(index);
+    if(stringID.sd)
+    {
+      TP_MUTEX_LOCKER(stringID.sd->mutex);
+      stringID.sd->referenceCount++;
+    }
+  }
+
+  return stringID;
+}
+
+//##################################################################################################
+std::vector<StringID> StringID::fromIndexes(const std::vector<size_t>& indexes)
+{
+  std::vector<StringID> result(indexes.size());
+
+  StaticData& staticData(StringID::staticData());
+  TP_MUTEX_LOCKER(staticData.mutex);
+
+  for(size_t i=0; i<indexes.size(); i++)
+  {
+    if(indexes.at(i)<staticData.indexes.size())
+    {
+      StringID& stringID = result.at(i);
+      stringID.sd = staticData.indexes.at(indexes.at(i));
+      if(stringID.sd)
+      {
+        TP_MUTEX_LOCKER(stringID.sd->mutex);
+        stringID.sd->referenceCount++;
+      }
+    }
+  }
+
+  return result;
+}
+
+//##################################################################################################
+size_t StringID::indexCount()
+{
+  StaticData& staticData(StringID::staticData());
+  TP_MUTEX_LOCKER(staticData.mutex);
+  return staticData.indexes.size();
+}
+
 //##################################################################################################
 std::vector<std::string> StringID::toStringList(const std::vector<StringID>& stringIDs)
 {
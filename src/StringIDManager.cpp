@@ -1,11 +1,10 @@
 #include "tp_utils/StringIDManager.h"
 #include "tp_utils/StringID.h"
 #include "tp_utils/MutexUtils.h"
+#include "tp_utils/FlatHashMap.h"
 
 #include "json.hpp"
 
-#include <map>
-
 namespace tp_utils
 {
 //##################################################################################################
@@ -13,8 +12,8 @@ struct StringIDManager::Private
 {
   TPMutex mutex{TPM};
 
-  std::map<std::string, int64_t> keys;
-  std::map<int64_t, std::string> stringKeys;
+  FlatHashMap<std::string, int64_t> keys;
+  FlatHashMap<int64_t, std::string> stringKeys;
 };
 
 //##################################################################################################
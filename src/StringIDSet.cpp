@@ -0,0 +1,604 @@
+#include "tp_utils/StringIDSet.h"
+
+#include <algorithm>
+#include <iterator>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace tp_utils
+{
+
+namespace
+{
+using Container = detail::StringIDSetContainer;
+constexpr size_t bitmapWords = Container::bitmapWords;
+constexpr size_t arrayMax = Container::arrayMax;
+
+//##################################################################################################
+size_t popCount(uint64_t word)
+{
+#ifdef __GNUC__
+  return size_t(__builtin_popcountll(word));
+#else
+  word = word - ((word>>1) & 0x5555555555555555ull);
+  word = (word & 0x3333333333333333ull) + ((word>>2) & 0x3333333333333333ull);
+  word = (word + (word>>4)) & 0x0F0F0F0F0F0F0F0Full;
+  return size_t((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+//##################################################################################################
+enum class BitOp
+{
+  Or,
+  And,
+  AndNot
+};
+
+//##################################################################################################
+template<BitOp op>
+uint64_t combine(uint64_t a, uint64_t b)
+{
+  if constexpr(op==BitOp::Or)
+    return a|b;
+  else if constexpr(op==BitOp::And)
+    return a&b;
+  else
+    return a&~b;
+}
+
+//##################################################################################################
+//! Combine two bitmaps into out, which may be a, and return the number of bits set in the result.
+template<BitOp op>
+size_t combineBitmaps(const uint64_t* a, const uint64_t* b, uint64_t* out)
+{
+  size_t w=0;
+
+#if defined(__AVX2__)
+  for(; w<bitmapWords; w+=4)
+  {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a+w));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+w));
+    __m256i r;
+    if constexpr(op==BitOp::Or)
+      r = _mm256_or_si256(va, vb);
+    else if constexpr(op==BitOp::And)
+      r = _mm256_and_si256(va, vb);
+    else
+      r = _mm256_andnot_si256(vb, va);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out+w), r);
+  }
+#elif defined(__SSE2__)
+  for(; w<bitmapWords; w+=2)
+  {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a+w));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+w));
+    __m128i r;
+    if constexpr(op==BitOp::Or)
+      r = _mm_or_si128(va, vb);
+    else if constexpr(op==BitOp::And)
+      r = _mm_and_si128(va, vb);
+    else
+      r = _mm_andnot_si128(vb, va);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out+w), r);
+  }
+#endif
+
+  for(; w<bitmapWords; w++)
+    out[w] = combine<op>(a[w], b[w]);
+
+  size_t cardinality=0;
+  for(w=0; w<bitmapWords; w++)
+    cardinality += popCount(out[w]);
+  return cardinality;
+}
+
+//##################################################################################################
+bool testBit(const Container& c, uint16_t value)
+{
+  return (c.bitmap[value>>6] >> (value&63)) & 1;
+}
+
+//##################################################################################################
+void toBitmap(Container& c)
+{
+  c.bitmap.assign(bitmapWords, 0);
+  for(uint16_t value : c.array)
+    c.bitmap[value>>6] |= uint64_t(1) << (value&63);
+  c.array = std::vector<uint16_t>();
+}
+
+//##################################################################################################
+void toArray(Container& c)
+{
+  std::vector<uint16_t> array;
+  array.reserve(c.cardinality);
+  for(size_t w=0; w<bitmapWords; w++)
+    for(uint64_t word = c.bitmap[w]; word; word &= word-1)
+      array.push_back(uint16_t((w<<6) | detail::countTrailingZeros(word)));
+
+  c.array = std::move(array);
+  c.bitmap = std::vector<uint64_t>();
+}
+
+//##################################################################################################
+//! Containers are bitmaps if and only if they hold more than arrayMax values.
+void normalize(Container& c)
+{
+  if(c.isBitmap())
+  {
+    if(c.cardinality<=arrayMax)
+      toArray(c);
+  }
+  else
+  {
+    c.cardinality = c.array.size();
+    if(c.cardinality>arrayMax)
+      toBitmap(c);
+  }
+}
+
+//##################################################################################################
+void uniteInto(Container& a, const Container& b)
+{
+  if(a.isBitmap() && b.isBitmap())
+    a.cardinality = combineBitmaps<BitOp::Or>(a.bitmap.data(), b.bitmap.data(), a.bitmap.data());
+
+  else if(a.isBitmap() || b.isBitmap())
+  {
+    Container result = a.isBitmap()?a:b;
+    for(uint16_t value : (a.isBitmap()?b:a).array)
+    {
+      uint64_t& word = result.bitmap[value>>6];
+      uint64_t bit = uint64_t(1) << (value&63);
+      result.cardinality += (word&bit)?0:1;
+      word |= bit;
+    }
+    result.key = a.key;
+    a = std::move(result);
+  }
+
+  else
+  {
+    std::vector<uint16_t> array;
+    array.reserve(a.array.size() + b.array.size());
+    std::set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(array));
+    a.array = std::move(array);
+    normalize(a);
+  }
+}
+
+//##################################################################################################
+void intersectInto(Container& a, const Container& b)
+{
+  if(a.isBitmap() && b.isBitmap())
+  {
+    a.cardinality = combineBitmaps<BitOp::And>(a.bitmap.data(), b.bitmap.data(), a.bitmap.data());
+    normalize(a);
+  }
+
+  else if(a.isBitmap())
+  {
+    std::vector<uint16_t> array;
+    array.reserve(b.array.size());
+    for(uint16_t value : b.array)
+      if(testBit(a, value))
+        array.push_back(value);
+
+    a.array = std::move(array);
+    a.bitmap = std::vector<uint64_t>();
+    normalize(a);
+  }
+
+  else if(b.isBitmap())
+  {
+    a.array.erase(std::remove_if(a.array.begin(), a.array.end(), [&](uint16_t value){return !testBit(b, value);}), a.array.end());
+    normalize(a);
+  }
+
+  else
+  {
+    std::vector<uint16_t> array;
+    array.reserve(tpMin(a.array.size(), b.array.size()));
+    std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(array));
+    a.array = std::move(array);
+    normalize(a);
+  }
+}
+
+//##################################################################################################
+void subtractInto(Container& a, const Container& b)
+{
+  if(a.isBitmap() && b.isBitmap())
+  {
+    a.cardinality = combineBitmaps<BitOp::AndNot>(a.bitmap.data(), b.bitmap.data(), a.bitmap.data());
+    normalize(a);
+  }
+
+  else if(a.isBitmap())
+  {
+    for(uint16_t value : b.array)
+    {
+      uint64_t& word = a.bitmap[value>>6];
+      uint64_t bit = uint64_t(1) << (value&63);
+      a.cardinality -= (word&bit)?1:0;
+      word &= ~bit;
+    }
+    normalize(a);
+  }
+
+  else if(b.isBitmap())
+  {
+    a.array.erase(std::remove_if(a.array.begin(), a.array.end(), [&](uint16_t value){return testBit(b, value);}), a.array.end());
+    normalize(a);
+  }
+
+  else
+  {
+    std::vector<uint16_t> array;
+    array.reserve(a.array.size());
+    std::set_difference(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), std::back_inserter(array));
+    a.array = std::move(array);
+    normalize(a);
+  }
+}
+
+//##################################################################################################
+size_t intersectionCount(const Container& a, const Container& b)
+{
+  size_t count=0;
+
+  if(a.isBitmap() && b.isBitmap())
+  {
+    for(size_t w=0; w<bitmapWords; w++)
+      count += popCount(a.bitmap[w] & b.bitmap[w]);
+  }
+
+  else if(a.isBitmap() || b.isBitmap())
+  {
+    const Container& bitmap = a.isBitmap()?a:b;
+    for(uint16_t value : (a.isBitmap()?b:a).array)
+      count += testBit(bitmap, value)?1:0;
+  }
+
+  else
+  {
+    auto i = a.array.begin();
+    auto j = b.array.begin();
+    while(i!=a.array.end() && j!=b.array.end())
+    {
+      if(*i<*j)
+        ++i;
+      else if(*j<*i)
+        ++j;
+      else
+      {
+        count++;
+        ++i;
+        ++j;
+      }
+    }
+  }
+
+  return count;
+}
+
+//##################################################################################################
+std::vector<Container>::iterator findContainer(std::vector<Container>& containers, uint16_t key)
+{
+  return std::lower_bound(containers.begin(), containers.end(), key, [](const Container& c, uint16_t k){return c.key<k;});
+}
+
+//##################################################################################################
+std::vector<Container>::const_iterator findContainer(const std::vector<Container>& containers, uint16_t key)
+{
+  return std::lower_bound(containers.begin(), containers.end(), key, [](const Container& c, uint16_t k){return c.key<k;});
+}
+}
+
+namespace detail
+{
+//##################################################################################################
+bool StringIDSetContainer::operator==(const StringIDSetContainer& other) const
+{
+  return key==other.key && cardinality==other.cardinality && array==other.array && bitmap==other.bitmap;
+}
+}
+
+//##################################################################################################
+StringIDSet::StringIDSet(std::initializer_list<StringID> stringIDs)
+{
+  for(const auto& stringID : stringIDs)
+    insert(stringID);
+}
+
+//##################################################################################################
+StringIDSet::StringIDSet(const std::vector<StringID>& stringIDs)
+{
+  for(const auto& stringID : stringIDs)
+    insert(stringID);
+}
+
+//##################################################################################################
+bool StringIDSet::insert(const StringID& stringID)
+{
+  size_t index = stringID.index();
+  if(!index)
+    return false;
+
+  uint16_t key = uint16_t(index>>16);
+  uint16_t value = uint16_t(index);
+
+  auto c = findContainer(m_containers, key);
+  if(c==m_containers.end() || c->key!=key)
+  {
+    c = m_containers.emplace(c);
+    c->key = key;
+  }
+
+  if(c->isBitmap())
+  {
+    uint64_t& word = c->bitmap[value>>6];
+    uint64_t bit = uint64_t(1) << (value&63);
+    if(word&bit)
+      return false;
+
+    word |= bit;
+    c->cardinality++;
+    return true;
+  }
+
+  auto i = std::lower_bound(c->array.begin(), c->array.end(), value);
+  if(i!=c->array.end() && *i==value)
+    return false;
+
+  c->array.insert(i, value);
+  normalize(*c);
+  return true;
+}
+
+//##################################################################################################
+bool StringIDSet::erase(const StringID& stringID)
+{
+  size_t index = stringID.index();
+  uint16_t key = uint16_t(index>>16);
+  uint16_t value = uint16_t(index);
+
+  auto c = findContainer(m_containers, key);
+  if(!index || c==m_containers.end() || c->key!=key)
+    return false;
+
+  if(c->isBitmap())
+  {
+    uint64_t& word = c->bitmap[value>>6];
+    uint64_t bit = uint64_t(1) << (value&63);
+    if(!(word&bit))
+      return false;
+
+    word &= ~bit;
+    c->cardinality--;
+  }
+  else
+  {
+    auto i = std::lower_bound(c->array.begin(), c->array.end(), value);
+    if(i==c->array.end() || *i!=value)
+      return false;
+
+    c->array.erase(i);
+  }
+
+  normalize(*c);
+  if(!c->cardinality)
+    m_containers.erase(c);
+  return true;
+}
+
+//##################################################################################################
+bool StringIDSet::contains(const StringID& stringID) const
+{
+  size_t index = stringID.index();
+  uint16_t key = uint16_t(index>>16);
+  uint16_t value = uint16_t(index);
+
+  auto c = findContainer(m_containers, key);
+  if(!index || c==m_containers.end() || c->key!=key)
+    return false;
+
+  if(c->isBitmap())
+    return testBit(*c, value);
+
+  return std::binary_search(c->array.begin(), c->array.end(), value);
+}
+
+//##################################################################################################
+size_t StringIDSet::count(const StringID& stringID) const
+{
+  return contains(stringID)?1:0;
+}
+
+//##################################################################################################
+size_t StringIDSet::size() const
+{
+  size_t size=0;
+  for(const auto& c : m_containers)
+    size += c.cardinality;
+  return size;
+}
+
+//##################################################################################################
+bool StringIDSet::empty() const
+{
+  return m_containers.empty();
+}
+
+//##################################################################################################
+void StringIDSet::clear()
+{
+  m_containers.clear();
+}
+
+//##################################################################################################
+bool StringIDSet::intersects(const StringIDSet& other) const
+{
+  for(const auto& c : other.m_containers)
+    if(auto i = findContainer(m_containers, c.key); i!=m_containers.end() && i->key==c.key && intersectionCount(*i, c))
+      return true;
+  return false;
+}
+
+//##################################################################################################
+bool StringIDSet::includes(const StringIDSet& other) const
+{
+  for(const auto& c : other.m_containers)
+  {
+    auto i = findContainer(m_containers, c.key);
+    if(i==m_containers.end() || i->key!=c.key || i->cardinality<c.cardinality)
+      return false;
+
+    if(intersectionCount(*i, c)!=c.cardinality)
+      return false;
+  }
+  return true;
+}
+
+//##################################################################################################
+size_t StringIDSet::intersectionSize(const StringIDSet& other) const
+{
+  size_t count=0;
+  for(const auto& c : other.m_containers)
+    if(auto i = findContainer(m_containers, c.key); i!=m_containers.end() && i->key==c.key)
+      count += intersectionCount(*i, c);
+  return count;
+}
+
+//##################################################################################################
+std::vector<size_t> StringIDSet::indexes() const
+{
+  std::vector<size_t> indexes;
+  indexes.reserve(size());
+  forEachIndex([&](size_t index){indexes.push_back(index);});
+  return indexes;
+}
+
+//##################################################################################################
+std::vector<StringID> StringIDSet::toVector() const
+{
+  return StringID::fromIndexes(indexes());
+}
+
+//##################################################################################################
+StringIDSet& StringIDSet::operator|=(const StringIDSet& other)
+{
+  std::vector<Container> result;
+  result.reserve(m_containers.size() + other.m_containers.size());
+
+  auto a = m_containers.begin();
+  auto b = other.m_containers.begin();
+  while(a!=m_containers.end() || b!=other.m_containers.end())
+  {
+    if(b==other.m_containers.end() || (a!=m_containers.end() && a->key<b->key))
+      result.push_back(std::move(*(a++)));
+    else if(a==m_containers.end() || b->key<a->key)
+      result.push_back(*(b++));
+    else
+    {
+      uniteInto(*a, *(b++));
+      result.push_back(std::move(*(a++)));
+    }
+  }
+
+  m_containers = std::move(result);
+  return *this;
+}
+
+//##################################################################################################
+StringIDSet& StringIDSet::operator&=(const StringIDSet& other)
+{
+  std::vector<Container> result;
+  result.reserve(tpMin(m_containers.size(), other.m_containers.size()));
+
+  auto a = m_containers.begin();
+  auto b = other.m_containers.begin();
+  while(a!=m_containers.end() && b!=other.m_containers.end())
+  {
+    if(a->key<b->key)
+      ++a;
+    else if(b->key<a->key)
+      ++b;
+    else
+    {
+      intersectInto(*a, *(b++));
+      if(a->cardinality)
+        result.push_back(std::move(*a));
+      ++a;
+    }
+  }
+
+  m_containers = std::move(result);
+  return *this;
+}
+
+//##################################################################################################
+StringIDSet& StringIDSet::operator-=(const StringIDSet& other)
+{
+  std::vector<Container> result;
+  result.reserve(m_containers.size());
+
+  auto b = other.m_containers.begin();
+  for(auto& a : m_containers)
+  {
+    while(b!=other.m_containers.end() && b->key<a.key)
+      ++b;
+
+    if(b!=other.m_containers.end() && b->key==a.key)
+      subtractInto(a, *b);
+
+    if(a.cardinality)
+      result.push_back(std::move(a));
+  }
+
+  m_containers = std::move(result);
+  return *this;
+}
+
+//##################################################################################################
+bool StringIDSet::operator==(const StringIDSet& other) const
+{
+  return m_containers==other.m_containers;
+}
+
+//##################################################################################################
+bool StringIDSet::operator!=(const StringIDSet& other) const
+{
+  return !(m_containers==other.m_containers);
+}
+
+//##################################################################################################
+StringIDSet operator|(const StringIDSet& a, const StringIDSet& b)
+{
+  StringIDSet result(a);
+  result |= b;
+  return result;
+}
+
+//##################################################################################################
+StringIDSet operator&(const StringIDSet& a, const StringIDSet& b)
+{
+  StringIDSet result(a);
+  result &= b;
+  return result;
+}
+
+//##################################################################################################
+StringIDSet operator-(const StringIDSet& a, const StringIDSet& b)
+{
+  StringIDSet result(a);
+  result -= b;
+  return result;
+}
+
+}
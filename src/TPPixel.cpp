@@ -0,0 +1,227 @@
+#include "tp_utils/TPPixel.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace tp_utils
+{
+
+namespace
+{
+//##################################################################################################
+//! x/255 rounded to nearest for x in [0, 255*255].
+inline uint32_t div255(uint32_t x)
+{
+  x += 128;
+  return (x + (x>>8)) >> 8;
+}
+
+#ifdef __SSE2__
+//##################################################################################################
+inline __m128i div255(__m128i x)
+{
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+//##################################################################################################
+//! Copy the alpha of each pixel, held as 16 bit channels, into all four of its channels.
+inline __m128i broadcastAlpha(__m128i v)
+{
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+  return _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+}
+#endif
+
+//##################################################################################################
+template<typename T>
+void forEachRow(const TPPixelView& view, const T& closure)
+{
+  if(view.isContiguous())
+    closure(view.data, view.width*view.height);
+  else
+    for(size_t y=0; y<view.height; y++)
+      closure(view.row(y), view.width);
+}
+}
+
+//##################################################################################################
+void fillPixels(TPPixel* pixels, size_t count, TPPixel value)
+{
+  std::fill_n(pixels, count, value);
+}
+
+//##################################################################################################
+void fillPixels(const TPPixelView& view, TPPixel value)
+{
+  forEachRow(view, [&](TPPixel* pixels, size_t count){fillPixels(pixels, count, value);});
+}
+
+//##################################################################################################
+void premultiplyAlpha(TPPixel* pixels, size_t count)
+{
+  TPPixel* p = pixels;
+  TPPixel* pMax = pixels + count;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alphaMask = _mm_set1_epi32(int32_t(0xFF000000));
+  for(; (pMax-p)>=4; p+=4)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i lo = _mm_unpacklo_epi8(v, zero);
+    __m128i hi = _mm_unpackhi_epi8(v, zero);
+    lo = div255(_mm_mullo_epi16(lo, broadcastAlpha(lo)));
+    hi = div255(_mm_mullo_epi16(hi, broadcastAlpha(hi)));
+    __m128i result = _mm_packus_epi16(lo, hi);
+    result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, v));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), result);
+  }
+#endif
+
+  for(; p<pMax; p++)
+  {
+    uint32_t a = p->a;
+    p->r = uint8_t(div255(p->r*a));
+    p->g = uint8_t(div255(p->g*a));
+    p->b = uint8_t(div255(p->b*a));
+  }
+}
+
+//##################################################################################################
+void premultiplyAlpha(const TPPixelView& view)
+{
+  forEachRow(view, [&](TPPixel* pixels, size_t count){premultiplyAlpha(pixels, count);});
+}
+
+//##################################################################################################
+void swapRedBlue(TPPixel* pixels, size_t count)
+{
+  TPPixel* p = pixels;
+  TPPixel* pMax = pixels + count;
+
+#ifdef __SSE2__
+  const __m128i keep = _mm_set1_epi32(int32_t(0xFF00FF00));
+  const __m128i low = _mm_set1_epi32(0x000000FF);
+  for(; (pMax-p)>=4; p+=4)
+  {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i r = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(r, b)));
+  }
+#endif
+
+  for(; p<pMax; p++)
+    std::swap(p->r, p->b);
+}
+
+//##################################################################################################
+void swapRedBlue(const TPPixelView& view)
+{
+  forEachRow(view, [&](TPPixel* pixels, size_t count){swapRedBlue(pixels, count);});
+}
+
+//##################################################################################################
+void blendPixels(TPPixel* dst, const TPPixel* src, size_t count)
+{
+  TPPixel* d = dst;
+  TPPixel* dMax = dst + count;
+  const TPPixel* s = src;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i max = _mm_set1_epi16(255);
+  for(; (dMax-d)>=4; d+=4, s+=4)
+  {
+    __m128i sv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    __m128i dv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(d));
+
+    __m128i inverseLo = _mm_sub_epi16(max, broadcastAlpha(_mm_unpacklo_epi8(sv, zero)));
+    __m128i inverseHi = _mm_sub_epi16(max, broadcastAlpha(_mm_unpackhi_epi8(sv, zero)));
+
+    __m128i lo = div255(_mm_mullo_epi16(_mm_unpacklo_epi8(dv, zero), inverseLo));
+    __m128i hi = div255(_mm_mullo_epi16(_mm_unpackhi_epi8(dv, zero), inverseHi));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(d), _mm_adds_epu8(sv, _mm_packus_epi16(lo, hi)));
+  }
+#endif
+
+  for(; d<dMax; d++, s++)
+  {
+    uint32_t inverse = 255u - s->a;
+    d->r = uint8_t(tpMin(255u, s->r + div255(d->r*inverse)));
+    d->g = uint8_t(tpMin(255u, s->g + div255(d->g*inverse)));
+    d->b = uint8_t(tpMin(255u, s->b + div255(d->b*inverse)));
+    d->a = uint8_t(tpMin(255u, s->a + div255(d->a*inverse)));
+  }
+}
+
+//##################################################################################################
+void blendPixels(const TPPixelView& dst, const TPPixelView& src)
+{
+  if(dst.isContiguous() && src.isContiguous())
+    blendPixels(dst.data, src.data, dst.width*dst.height);
+  else
+    for(size_t y=0; y<dst.height; y++)
+      blendPixels(dst.row(y), src.row(y), dst.width);
+}
+
+//##################################################################################################
+size_t parseColors(const std::string_view* colors, size_t count, TPPixel* output)
+{
+  //The digits of a block of colors are gathered into one buffer, with "FF" standing in for a
+  //missing alpha, so that they can be decoded together by the vectorized tpFromHEX. Colors are
+  //only decoded one at a time if the block contains an invalid digit.
+  constexpr size_t blockSize=64;
+  char digits[blockSize*8];
+  uint8_t bytes[blockSize*4];
+  size_t indexes[blockSize];
+
+  size_t valid=0;
+  for(size_t b=0; b<count; b+=blockSize)
+  {
+    size_t bMax = tpMin(count, b+blockSize);
+    size_t n=0;
+    for(size_t i=b; i<bMax; i++)
+    {
+      const std::string_view& color = colors[i];
+      output[i] = TPPixel();
+      if((color.size()==7 || color.size()==9) && color.front()=='#')
+      {
+        char* d = digits + n*8;
+        std::memcpy(d, color.data()+1, color.size()-1);
+        if(color.size()==7)
+          d[6] = d[7] = 'F';
+        indexes[n++] = i;
+      }
+    }
+
+    bool allValid = tpFromHEX(std::string_view(digits, n*8), bytes);
+    for(size_t j=0; j<n; j++)
+    {
+      const uint8_t* c = bytes + j*4;
+      if(allValid || tpFromHEX(std::string_view(digits + j*8, 8), bytes + j*4))
+      {
+        output[indexes[j]] = TPPixel(c[0], c[1], c[2], c[3]);
+        valid++;
+      }
+    }
+  }
+
+  return valid;
+}
+
+//##################################################################################################
+std::vector<TPPixel> parseColors(const std::vector<std::string>& colors)
+{
+  std::vector<std::string_view> views(colors.begin(), colors.end());
+  std::vector<TPPixel> output(colors.size());
+  parseColors(views.data(), views.size(), output.data());
+  return output;
+}
+
+}
@@ -5,15 +5,27 @@ DEFINES += TP_UTILS_LIBRARY
 
 SOURCES += src/Globals.cpp
 HEADERS += inc/tp_utils/Globals.h
+HEADERS += inc/tp_utils/FlatHashMap.h
+HEADERS += inc/tp_utils/SmallVector.h
 
 SOURCES += src/FileUtils.cpp
 HEADERS += inc/tp_utils/FileUtils.h
 
+SOURCES += src/AsyncFileIO.cpp
+HEADERS += inc/tp_utils/AsyncFileIO.h
+
+SOURCES += src/FileWatcher.cpp
+HEADERS += inc/tp_utils/FileWatcher.h
+
 SOURCES += src/JSONUtils.cpp
 HEADERS += inc/tp_utils/JSONUtils.h
 
 SOURCES += src/StringID.cpp
 HEADERS += inc/tp_utils/StringID.h
+HEADERS += inc/tp_utils/StringIDMap.h
+
+SOURCES += src/StringIDSet.cpp
+HEADERS += inc/tp_utils/StringIDSet.h
 
 SOURCES += src/StringIDManager.cpp
 HEADERS += inc/tp_utils/StringIDManager.h
@@ -41,8 +53,17 @@ HEADERS += inc/tp_utils/Resources.h
 
 HEADERS += inc/tp_utils/CallbackCollection.h
 
+SOURCES += src/Interface.cpp
 HEADERS += inc/tp_utils/Interface.h
 
+SOURCES += src/TPPixel.cpp
 HEADERS += inc/tp_utils/TPPixel.h
 
+SOURCES += src/PixelConversions.cpp
+HEADERS += inc/tp_utils/PixelConversions.h
+
+SOURCES += src/PageSize.cpp
 HEADERS += inc/tp_utils/PageSize.h
+
+SOURCES += src/PageAllocator.cpp
+HEADERS += inc/tp_utils/PageAllocator.h